@@ -1,6 +1,8 @@
 #ifndef COMAIR_HELPER_H
 #define COMAIR_HELPER_H
 
+#include <set>
+
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Function.h"
@@ -34,6 +36,8 @@ bool IsRecursiveCall(std::string callerName, std::string calleeName);
 
 bool IsRecursiveCall(Function *F);
 
+void SearchRecursiveGroup(Function *pRoot, std::set<Function *> &setGroup);
+
 std::string printSrcCodeInfo(Instruction *pInst);
 
 std::string printSrcCodeInfo(Function *F);
@@ -0,0 +1,27 @@
+#ifndef COMAIR_INPUTDEPENDENCE_H
+#define COMAIR_INPUTDEPENDENCE_H
+
+#include <set>
+#include <vector>
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+
+using namespace llvm;
+using namespace std;
+
+/*
+ * Values of the function holding setRegion and of vecCallees that derive from the inputs of the region:
+ * the arguments of the function, the results of calls in the blocks dominating the region entries, and the
+ * globals the region and the callees read. Memory is tracked per local variable (alloca) and scalar global:
+ * a load is input-dependent when its address is, or when it reads a scalar global or a local variable that
+ * was assigned an input-dependent value.
+ */
+void SearchInputDependentValues(set<BasicBlock *> &setRegion, vector<Function *> &vecCallees,
+                                set<Value *> &setDependent);
+
+// whether the address accessed by a load or a store derives from the inputs
+bool IsInputDependentAccess(Instruction *I, set<Value *> &setDependent);
+
+#endif //COMAIR_INPUTDEPENDENCE_H
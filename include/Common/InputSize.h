@@ -0,0 +1,22 @@
+#ifndef COMAIR_INPUTSIZE_H
+#define COMAIR_INPUTSIZE_H
+
+#include <vector>
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instruction.h"
+
+using namespace llvm;
+using namespace std;
+
+bool IsWrittenInLoop(Value *pPointer, Loop *pLoop);
+
+bool IsInvariantAtEntry(Value *V, Loop *pLoop, DominatorTree *DT);
+
+void SearchInputSizes(Loop *pLoop, ScalarEvolution *SE, DominatorTree *DT, vector<Value *> &vecInputs);
+
+Value *MaterializeAtEntry(Value *V, Loop *pLoop, Instruction *InsertBefore);
+
+#endif //COMAIR_INPUTSIZE_H
@@ -0,0 +1,37 @@
+#ifndef COMAIR_LIBCMODEL_H
+#define COMAIR_LIBCMODEL_H
+
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+using namespace llvm;
+using namespace std;
+
+/*
+ * How many bytes a library call touches from one of its pointer arguments.
+ */
+enum LibcModelSize {
+    SIZE_CONSTANT,          // uSize0 bytes
+    SIZE_ARGUMENT,          // arg[uSize0] bytes
+    SIZE_ARGUMENT_PRODUCT,  // arg[uSize0] * arg[uSize1] bytes
+    SIZE_RETURN,            // ret bytes, nothing when ret <= 0
+    SIZE_RETURN_PRODUCT,    // ret * arg[uSize0] bytes
+    SIZE_STRING,            // strlen(ptr) + 1 bytes, taken after the call: an upper bound for a compare or a parse
+    SIZE_RETURN_OFFSET,     // up to the returned pointer included, the whole string when ret is NULL
+    SIZE_RETURN_OFFSET_ARGUMENT,    // up to the returned pointer included, arg[uSize0] bytes when ret is NULL
+};
+
+struct stLibcAccess {
+    const char *sName;      // a name ending with '.' matches as a prefix (intrinsics)
+    unsigned uPointerArg;
+    bool bWrite;
+    LibcModelSize eSize;
+    unsigned uSize0;
+    unsigned uSize1;
+};
+
+// all the accesses modelled for the called function, empty if it has no model
+void SearchLibcModel(StringRef sCalled, vector<const stLibcAccess *> &vecAccesses);
+
+#endif //COMAIR_LIBCMODEL_H
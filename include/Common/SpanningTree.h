@@ -0,0 +1,37 @@
+#ifndef COMAIR_SPANNINGTREE_H
+#define COMAIR_SPANNINGTREE_H
+
+#include <map>
+#include <vector>
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+
+using namespace llvm;
+using namespace std;
+
+/*
+ * An edge of the CFG region whose cost is counted.
+ * The region is closed by a virtual node (NULL): every edge leaving the region
+ * goes to it, and the single virtual edge (pSrc == NULL) comes back to the region entry.
+ */
+struct stCostEdge {
+    BasicBlock *pSrc;
+    BasicBlock *pDst;
+    uint64_t uFreq;
+    bool bChord;
+    long lIncrement;
+};
+
+int GetBlockCost(BasicBlock *BB);
+
+void GetEdgeFrequencies(Function *F, LoopInfo *pLI, map<pair<BasicBlock *, BasicBlock *>, uint64_t> &mapEdgeFreq);
+
+long GetExpectedFunctionCost(Function *F);
+
+void BuildMaxSpanningTree(vector<stCostEdge> &vecEdges);
+
+void ComputeChordIncrements(vector<stCostEdge> &vecEdges, map<BasicBlock *, int> &mapBlockCost);
+
+#endif //COMAIR_SPANNINGTREE_H
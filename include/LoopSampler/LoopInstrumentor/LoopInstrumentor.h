@@ -6,6 +6,10 @@
 #define NEWCOMAIR_LOOPINSTRUMENT_H
 
 #include "llvm/Pass.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 //#include "llvm/Transforms/Utils/ValueMapper.h"
 //#include "llvm/Analysis/AliasAnalysis.h"
 //#include "llvm/Analysis/AliasSetTracker.h"
@@ -13,6 +17,9 @@
 #include <map>
 #include <set>
 
+#include "Common/LibcModel.h"
+#include "Common/SpanningTree.h"
+
 using namespace llvm;
 using namespace std;
 
@@ -40,7 +47,7 @@ private:
 
     void SetupFunctions();
 
-    void InstrumentInnerLoop(Loop *pInnerLoop, PostDominatorTree *PDT);
+    void InstrumentInnerLoop(Loop *pInnerLoop, LoopInfo *pLI);
 
     void CreateIfElseBlock(Loop *pInnerLoop, std::vector<BasicBlock *> &vecAdded);
 
@@ -55,21 +62,106 @@ private:
 
     void InstrumentRecordMemHooks(std::vector<BasicBlock *> &vecAdd);
 
-    void CloneFunctionCalled(std::set<BasicBlock *> &setBlocksInLoop, ValueToValueMapTy &VCalleeMap, std::map<Function *, std::set<Instruction *> > &FuncCallSiteMapping);
+    void CloneFunctionCalled(std::set<BasicBlock *> &setBlocksInLoop, ValueToValueMapTy &VCalleeMap,
+                             std::map<Function *, std::set<Instruction *> > &FuncCallSiteMapping,
+                             std::set<Function *> &setSummarized);
+
+    // pointer arguments and expected cost of the calls to callees that were not cloned
+    void InstrumentCalleeSummary(std::vector<BasicBlock *> &vecBlocks, std::set<Function *> &setSummarized);
+    void InlineHookCalleeArgument(Value *pArg, Instruction *InsertBefore);
+
+    // load and store hooks, then the library calls found before them
+    void InstrumentAccesses(std::vector<BasicBlock *> &vecBlocks);
+
+    // ranges touched by library calls, see Common/LibcModel.h
+    void SearchLibcSites(std::vector<BasicBlock *> &vecBlocks,
+                         std::vector<std::pair<CallInst *, std::vector<const stLibcAccess *> > > &vecSites);
+    void InstrumentLibcModels(std::vector<std::pair<CallInst *, std::vector<const stLibcAccess *> > > &vecSites);
+    void InlineHookLibcAccess(CallInst *pCall, const stLibcAccess *pAccess, Instruction *InsertBefore);
+    Value *GetLongArgument(CallInst *pCall, unsigned uIndex, Instruction *InsertBefore);
+    Value *InlineStringSize(Value *pString, Instruction *InsertBefore);
+
+    // per-iteration markers of the loops nested in the sampled one
+    void InstrumentNestedMarkers(Loop *pLoop, ValueToValueMapTy &VMap);
+
+    // recursion sampled at the calls entering it
+    void InstrumentRecursiveFunction(Function *pRoot);
+    CallInst *DispatchCallSite(CallInst *pCall, Function *pTwin);
+
+    // the whole function of the loops sampled once per call
+    void InstrumentFunctionDispatch(Function *pFunction, LoopInfo *pLI);
+    CallInst *DispatchFunctionEntry(Function *pFunction, Function *pTwin);
+
+    void InlineResetCounter(BasicBlock *pBlock);
+    void InlineDecrementCounter(Instruction *InsertBefore);
+
+    // indirect calls: targets recorded in counter-only mode, promoted from a profile otherwise
+    void LoadIndirectProfile(const std::string &sPath);
+    void InstrumentIndirectTargets(std::vector<BasicBlock *> &vecBlocks);
+    void PromoteIndirectCalls(std::vector<BasicBlock *> &vecBlocks, ValueToValueMapTy &VCalleeMap);
+    void PromoteIndirectCall(CallInst *pCall, std::vector<Function *> &vecTargets, ValueToValueMapTy &VCalleeMap,
+                             std::vector<BasicBlock *> &vecAdded);
+
+    // redirect calls in the cloned code to the .CPI callees
+    void RemapCalledFunction(std::vector<BasicBlock *> &vecCloned, ValueToValueMapTy &VCalleeMap);
+
+    // put a block on each edge leaving the cloned loop, executed once per sampled invocation
+    void SplitClonedLoopExits(Loop *pLoop, ValueToValueMapTy &VMap, std::vector<BasicBlock *> &vecExitCPI);
+
+    BasicBlock *SplitEdgeCPI(BasicBlock *pFrom, BasicBlock *pTo, const std::string &sName);
+
+    void CollectLoopCostEdges(Loop *pLoop, ValueToValueMapTy &VMap,
+                              std::map<std::pair<BasicBlock *, BasicBlock *>, uint64_t> &mapEdgeFreq,
+                              std::vector<stCostEdge> &vecEdges);
+
+    void CollectCalleeCostEdges(Function *pRawFunction, ValueToValueMapTy &VCalleeMap, std::vector<stCostEdge> &vecEdges);
+
+    void InstrumentCostUpdater(std::vector<stCostEdge> &vecEdges, Instruction *pResetBefore);
+
+    void InlineIncrementCost(long lIncrement, Instruction *InsertBefore);
+    void InlineHookCost(Instruction *InsertBefore);
+
+    // trip count of the loop computed by SCEV in the preheader, NULL if not computable
+    Value *ExpandTripCount(Loop *pLoop, ScalarEvolution &SE, std::vector<Instruction *> &vecExpanded);
+
+    void InstrumentIterationCounter(Loop *pLoop, ValueToValueMapTy &VMap, Instruction *pResetBefore,
+                                    std::vector<BasicBlock *> &vecExitCPI);
+
+    Value *SearchInputByName(Function *pFunction, const std::string &sName, Instruction *InsertBefore);
+
+    void InlineHookTripCount(Value *pCount, Instruction *InsertBefore);
+    void InlineHookInputSize(Value *pSize, unsigned uIndex, Instruction *InsertBefore);
 
     void InstrumentMain();
 
-    void InlineMemcpy(Instruction *InsertBefore);
+    // pStride: bytes iBufferIndex_CPI advances by, 16 when NULL
+    void InlineMemcpy(Instruction *InsertBefore, Value *pStride = NULL);
 
     void InlineSetRecord(Value *address, Value *length, Value *flag, Instruction *InsertBefore);
-    void InlineHookDelimit(Instruction *InsertBefore);
+    void InlineHookDelimit(Instruction *InsertBefore, long lLoopID);
+    void InlineSetSampling(ConstantInt *pValue, Instruction *InsertBefore);
     void InlineHookStore(StoreInst *pStore, Instruction *InsertBefore);
     void InlineHookLoad(LoadInst *pLoad, Instruction *InsertBefore);
+    void InlineHookLine(Value *pAddress, ConstantInt *pFlag, Instruction *InsertBefore);
+    void InitLineSlots();
+    // kind | (ins_id + 1) << 8
+    ConstantInt *GetSiteFlag(ConstantInt *pKind, Instruction *pInst);
+    void InlineHookCoalesce(Value *pAddress, Value *pLength, ConstantInt *pFlag, Instruction *InsertBefore);
+    void InlineFlushAccesses(Instruction *InsertBefore);
+    void InlineHookDistinct(Value *pAddress, Value *pLength, ConstantInt *pFlag, Instruction *InsertBefore);
+    // atomic, volatile and read-modify-write accesses, attributed to the thread
+    void InlineHookShared(Value *pPointer, ConstantInt *pKind, Instruction *InsertBefore);
 
     /* Module */
     Module *pModule;
     std::set<int> setInstID;
     vector<std::pair<Function *, int> > vecParaID;
+    std::set<Value *> setInputDependent;
+    std::map<int, std::vector<Function *> > mapIndirectTargets;
+    // last recorded line of each load and store site, cache-line mode
+    std::map<Function *, std::vector<AllocaInst *> > mapLineSlots;
+    // functions whose slots a delimiter resets
+    std::set<Function *> setLineReset;
     /* ********** */
 
     /* Struct */
@@ -93,11 +185,14 @@ private:
     /* Global Variable */
     GlobalVariable *SAMPLE_RATE;
     GlobalVariable *numGlobalCounter;
+    GlobalVariable *numGlobalCost;
+    GlobalVariable *numGlobalIteration;
     GlobalVariable *Record_CPI;
     GlobalVariable *Records_CPI;
     GlobalVariable *pcBuffer_CPI;
     GlobalVariable *iBufferIndex_CPI;
     GlobalVariable *iRecordIndex_CPI;
+    GlobalVariable *iSampling_CPI;
     /* ***** */
 
     /* ***** */
@@ -113,6 +208,7 @@ private:
     Function *getenv;
     // sample_rate = atoi(sample_rate_str)
     Function *function_atoi;
+    Function *function_strlen;
     Function *func_llvm_memcpy;
 
     Function *geo;
@@ -120,6 +216,17 @@ private:
     // Init shared memory at the entry of main function.
     Function *InitMemHooks;
 
+    // ID of the current thread, for the shared accesses.
+    Function *GetThreadID;
+
+    // Merge adjacent accesses of a site, and write the open runs.
+    Function *CoalesceAccess;
+    Function *FlushAccesses;
+
+    // Drop the addresses already seen in the sampled invocation, and forget them at the delimiter.
+    Function *FilterAccess;
+    Function *ResetFilter;
+
     // Finalize shared memory at the return/exit of main function.
     Function *FinalizeMemHooks;
 
@@ -145,6 +252,15 @@ private:
     ConstantInt *ConstantInt3;  // store
     ConstantInt *ConstantInt4;  // memcpy
     ConstantInt *ConstantInt5;  // memmove
+    ConstantInt *ConstantInt6;  // cost
+    ConstantInt *ConstantInt7;  // trip count
+    ConstantInt *ConstantInt8;  // input size
+    ConstantInt *ConstantInt9;  // pointer argument of a summarized callee
+    ConstantInt *ConstantInt10; // target of an indirect call
+    ConstantInt *ConstantInt11; // iteration of a nested loop
+    ConstantInt *ConstantInt15; // atomic or volatile load
+    ConstantInt *ConstantInt16; // atomic or volatile store
+    ConstantInt *ConstantInt17; // atomicrmw, cmpxchg
     ConstantInt *ConstantLong10;
     ConstantInt *ConstantLong16;
     ConstantInt *ConstantIntFalse;
@@ -0,0 +1,142 @@
+#ifndef COMAIR_TRACEREADER_H
+#define COMAIR_TRACEREADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "Record.h"
+
+using namespace std;
+
+/*
+ * The records of one sampled invocation, between its delimiter and the next one.
+ * Points into the mapped trace, nothing is copied.
+ */
+class Invocation {
+
+public:
+
+    Invocation(const stMemRecord *pFirst, const stMemRecord *pLast) : pBegin(pFirst), pEnd(pLast) {}
+
+    const stMemRecord *begin() const { return pBegin; }
+
+    const stMemRecord *end() const { return pEnd; }
+
+    size_t size() const { return pEnd - pBegin; }
+
+private:
+
+    const stMemRecord *pBegin;
+    const stMemRecord *pEnd;
+};
+
+/*
+ * One invocation in the index kept next to the trace, <file>.idx or the shared memory <name>.idx.
+ */
+struct stIndexEntry {
+    uint64_t uDelimiter;    // record index of the delimiter
+    uint64_t uSequence;
+    int64_t lLoopID;
+    uint64_t uRecords;      // records after the delimiter
+};
+
+/*
+ * Walks the invocations of a trace, finding the next delimiter on each increment.
+ */
+class InvocationIterator {
+
+public:
+
+    InvocationIterator(const stMemRecord *pDelimiter, const stMemRecord *pTraceEnd);
+
+    Invocation operator*() const { return Invocation(pCurrent + 1, pNext); }
+
+    InvocationIterator &operator++();
+
+    bool operator==(const InvocationIterator &Other) const { return pCurrent == Other.pCurrent; }
+
+    bool operator!=(const InvocationIterator &Other) const { return pCurrent != Other.pCurrent; }
+
+private:
+
+    const stMemRecord *SearchDelimiter(const stMemRecord *pFrom) const;
+
+    const stMemRecord *pCurrent;
+    const stMemRecord *pNext;
+    const stMemRecord *pEnd;
+};
+
+/*
+ * A trace mapped read-only, from the shared memory of the runtime or from a file.
+ * Records are the whole 16-byte entries of a finalized trace, a partial entry at the tail is dropped. The buffer of
+ * an unfinished run is cut at the zero tail past its last record.
+ */
+class TraceReader {
+
+public:
+
+    TraceReader();
+
+    ~TraceReader();
+
+    // the name as given to shm_open, newcomair_123456789 for the runtime
+    bool OpenShm(const string &sName);
+
+    bool OpenFile(const string &sPath);
+
+    void Close();
+
+    const string &GetError() const { return sError; }
+
+    /* records */
+    const stMemRecord *begin() const { return pRecords; }
+
+    const stMemRecord *end() const { return pRecords + uRecords; }
+
+    size_t size() const { return uRecords; }
+
+    // aborts on an index out of the trace
+    const stMemRecord &At(size_t uIndex) const;
+
+    /* invocations, the records before the first delimiter belong to none */
+    InvocationIterator BeginInvocations() const;
+
+    InvocationIterator EndInvocations() const;
+
+    Invocation GetInvocation(vector<size_t> &vecDelimiters, size_t uIndex) const;
+
+    // indexes of the delimiters with the end of the trace appended, scanned by uThreads threads
+    void SearchDelimiters(vector<size_t> &vecDelimiters, unsigned uThreads) const;
+
+    // the index of the trace: read when it matches the size and time of the trace, built and written otherwise
+    bool LoadIndex(vector<stIndexEntry> &vecIndex, unsigned uThreads);
+
+    Invocation GetInvocation(const stIndexEntry &Entry) const;
+
+private:
+
+    bool Map(int fd, const string &sName);
+
+    bool ReadIndex(vector<stIndexEntry> &vecIndex);
+
+    void WriteIndex(vector<stIndexEntry> &vecIndex);
+
+    int OpenIndex(int iFlags);
+
+    const stMemRecord *pRecords;
+    size_t uRecords;
+    void *pMap;
+    size_t uMapSize;
+    string sError;
+
+    /* where the trace came from, for its index */
+    string sName;
+    bool bShm;
+    uint64_t uTraceBytes;
+    int64_t lTraceTime;
+};
+
+#endif //COMAIR_TRACEREADER_H
@@ -404,3 +404,54 @@ std::string getClonedFunctionName(Module *M, std::string FuncName) {
 
     return NULL;
 }
+
+static void SearchReachableFunctions(Function *pStart, std::set<Function *> &setReachable) {
+
+    std::vector<Function *> vecWorkList;
+    vecWorkList.push_back(pStart);
+
+    while (!vecWorkList.empty()) {
+
+        Function *pCurrent = vecWorkList.back();
+        vecWorkList.pop_back();
+
+        for (Function::iterator BB = pCurrent->begin(); BB != pCurrent->end(); BB++) {
+            for (BasicBlock::iterator II = BB->begin(); II != BB->end(); II++) {
+
+                if (!isa<CallInst>(II) && !isa<InvokeInst>(II)) {
+                    continue;
+                }
+
+                CallSite cs(&*II);
+                Function *pCalled = cs.getCalledFunction();
+
+                if (pCalled == NULL || pCalled->isDeclaration()) {
+                    continue;
+                }
+
+                if (setReachable.insert(pCalled).second) {
+                    vecWorkList.push_back(pCalled);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * The functions of the call graph SCC of pRoot (direct calls only), empty when pRoot is not recursive.
+ */
+void SearchRecursiveGroup(Function *pRoot, std::set<Function *> &setGroup) {
+
+    std::set<Function *> setFromRoot;
+    SearchReachableFunctions(pRoot, setFromRoot);
+
+    for (std::set<Function *>::iterator itFunc = setFromRoot.begin(); itFunc != setFromRoot.end(); itFunc++) {
+
+        std::set<Function *> setFromCallee;
+        SearchReachableFunctions(*itFunc, setFromCallee);
+
+        if (setFromCallee.find(pRoot) != setFromCallee.end()) {
+            setGroup.insert(*itFunc);
+        }
+    }
+}
@@ -0,0 +1,246 @@
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+#include "Common/InputDependence.h"
+
+using namespace llvm;
+using namespace std;
+
+
+static bool InsertDependent(Value *V, set<Value *> &setDependent) {
+    return setDependent.insert(V).second;
+}
+
+static bool IsDependentOperand(Instruction *I, set<Value *> &setDependent) {
+
+    for (unsigned i = 0; i < I->getNumOperands(); i++) {
+        if (setDependent.find(I->getOperand(i)) != setDependent.end()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * One pass over F, returns true if anything new became input-dependent.
+ * setMemory holds the local variables (allocas) written with an input-dependent value.
+ */
+static bool PropagateDependence(Function *F, set<Function *> &setCallees, set<Value *> &setDependent,
+                                set<Value *> &setMemory) {
+
+    const DataLayout &DL = F->getParent()->getDataLayout();
+    bool bChanged = false;
+
+    for (Function::iterator BB = F->begin(); BB != F->end(); BB++) {
+        for (BasicBlock::iterator II = BB->begin(); II != BB->end(); II++) {
+
+            Instruction *I = &*II;
+
+            if (isa<DbgInfoIntrinsic>(I)) {
+                continue;
+            }
+
+            if (LoadInst *pLoad = dyn_cast<LoadInst>(I)) {
+
+                Value *pPointer = pLoad->getPointerOperand();
+                if (setDependent.find(pPointer) != setDependent.end() ||
+                    setMemory.find(GetUnderlyingObject(pPointer, DL)) != setMemory.end()) {
+                    bChanged |= InsertDependent(I, setDependent);
+                }
+
+            } else if (StoreInst *pStore = dyn_cast<StoreInst>(I)) {
+
+                Value *pObject = GetUnderlyingObject(pStore->getPointerOperand(), DL);
+                if (isa<AllocaInst>(pObject) &&
+                    setDependent.find(pStore->getValueOperand()) != setDependent.end()) {
+                    bChanged |= InsertDependent(pObject, setMemory);
+                }
+
+            } else if (isa<CallInst>(I) || isa<InvokeInst>(I)) {
+
+                CallSite cs(I);
+                Function *pCalled = cs.getCalledFunction();
+
+                if (pCalled && setCallees.find(pCalled) != setCallees.end()) {
+
+                    // arguments of the callee follow the actual parameters
+                    unsigned uIndex = 0;
+                    for (Function::arg_iterator AI = pCalled->arg_begin();
+                         AI != pCalled->arg_end() && uIndex < cs.arg_size(); AI++, uIndex++) {
+                        if (setDependent.find(cs.getArgument(uIndex)) != setDependent.end()) {
+                            bChanged |= InsertDependent(&*AI, setDependent);
+                        }
+                    }
+
+                    // the result follows the returned values
+                    for (Function::iterator CB = pCalled->begin(); CB != pCalled->end(); CB++) {
+                        if (ReturnInst *pRet = dyn_cast<ReturnInst>(CB->getTerminator())) {
+                            if (pRet->getReturnValue() &&
+                                setDependent.find(pRet->getReturnValue()) != setDependent.end()) {
+                                bChanged |= InsertDependent(I, setDependent);
+                            }
+                        }
+                    }
+
+                } else if (IsDependentOperand(I, setDependent)) {
+
+                    // an external call mixes its inputs into its result and into the locals it is given
+                    if (!I->getType()->isVoidTy()) {
+                        bChanged |= InsertDependent(I, setDependent);
+                    }
+
+                    for (unsigned i = 0; i < cs.arg_size(); i++) {
+                        Value *pArg = cs.getArgument(i);
+                        if (!pArg->getType()->isPointerTy()) {
+                            continue;
+                        }
+                        Value *pObject = GetUnderlyingObject(pArg, DL);
+                        if (isa<AllocaInst>(pObject)) {
+                            bChanged |= InsertDependent(pObject, setMemory);
+                        }
+                    }
+                }
+
+            } else if (isa<CastInst>(I) || isa<BinaryOperator>(I) || isa<GetElementPtrInst>(I) ||
+                       isa<SelectInst>(I) || isa<PHINode>(I) || isa<ExtractValueInst>(I) ||
+                       isa<InsertValueInst>(I)) {
+
+                if (IsDependentOperand(I, setDependent)) {
+                    bChanged |= InsertDependent(I, setDependent);
+                }
+            }
+        }
+    }
+
+    return bChanged;
+}
+
+/*
+ * Globals read by the blocks: an array or a struct is an input object, its accesses are kept; a scalar holds
+ * an input value, e.g. a pointer to the data, and goes to setMemory like a local assigned one.
+ */
+static void SearchInputGlobals(Function *F, set<BasicBlock *> *pRegion, set<Value *> &setDependent,
+                               set<Value *> &setMemory) {
+
+    const DataLayout &DL = F->getParent()->getDataLayout();
+
+    for (Function::iterator BB = F->begin(); BB != F->end(); BB++) {
+
+        if (pRegion != NULL && pRegion->find(&*BB) == pRegion->end()) {
+            continue;
+        }
+
+        for (BasicBlock::iterator II = BB->begin(); II != BB->end(); II++) {
+            for (unsigned i = 0; i < II->getNumOperands(); i++) {
+
+                Value *pOperand = II->getOperand(i);
+                if (!isa<Constant>(pOperand) || !pOperand->getType()->isPointerTy()) {
+                    continue;
+                }
+
+                GlobalVariable *pGlobal = dyn_cast<GlobalVariable>(GetUnderlyingObject(pOperand, DL));
+                if (pGlobal == NULL) {
+                    continue;
+                }
+
+                if (pGlobal->getValueType()->isAggregateType()) {
+                    // the global and its constant GEPs are the addresses themselves
+                    setDependent.insert(pGlobal);
+                    setDependent.insert(pOperand);
+                } else {
+                    setMemory.insert(pGlobal);
+                }
+            }
+        }
+    }
+}
+
+void SearchInputDependentValues(set<BasicBlock *> &setRegion, vector<Function *> &vecCallees,
+                                set<Value *> &setDependent) {
+
+    if (setRegion.empty()) {
+        return;
+    }
+
+    Function *pFunction = (*setRegion.begin())->getParent();
+
+    // the inputs: arguments, and what was computed by calls before the region
+    for (Function::arg_iterator AI = pFunction->arg_begin(); AI != pFunction->arg_end(); AI++) {
+        setDependent.insert(&*AI);
+    }
+
+    // the region is entered through the blocks with a predecessor outside, the loop headers
+    vector<BasicBlock *> vecEntries;
+    for (set<BasicBlock *>::iterator itBlock = setRegion.begin(); itBlock != setRegion.end(); itBlock++) {
+        if (*itBlock == &pFunction->getEntryBlock()) {
+            vecEntries.push_back(*itBlock);
+            continue;
+        }
+        for (pred_iterator PI = pred_begin(*itBlock); PI != pred_end(*itBlock); PI++) {
+            if (setRegion.find(*PI) == setRegion.end()) {
+                vecEntries.push_back(*itBlock);
+                break;
+            }
+        }
+    }
+
+    // a call the region may come after, not the original loop, nor the code after it
+    DominatorTree DT(*pFunction);
+
+    for (Function::iterator BB = pFunction->begin(); BB != pFunction->end(); BB++) {
+
+        if (setRegion.find(&*BB) != setRegion.end()) {
+            continue;
+        }
+
+        bool bBefore = false;
+        for (unsigned long i = 0; i < vecEntries.size() && !bBefore; i++) {
+            bBefore = DT.dominates(&*BB, vecEntries[i]);
+        }
+        if (!bBefore) {
+            continue;
+        }
+
+        for (BasicBlock::iterator II = BB->begin(); II != BB->end(); II++) {
+            if ((isa<CallInst>(II) || isa<InvokeInst>(II)) && !isa<DbgInfoIntrinsic>(II) &&
+                !II->getType()->isVoidTy()) {
+                setDependent.insert(&*II);
+            }
+        }
+    }
+
+    set<Function *> setCallees(vecCallees.begin(), vecCallees.end());
+    set<Value *> setMemory;
+
+    SearchInputGlobals(pFunction, &setRegion, setDependent, setMemory);
+    for (unsigned long i = 0; i < vecCallees.size(); i++) {
+        SearchInputGlobals(vecCallees[i], NULL, setDependent, setMemory);
+    }
+
+    bool bChanged = true;
+    while (bChanged) {
+        bChanged = PropagateDependence(pFunction, setCallees, setDependent, setMemory);
+        for (unsigned long i = 0; i < vecCallees.size(); i++) {
+            bChanged |= PropagateDependence(vecCallees[i], setCallees, setDependent, setMemory);
+        }
+    }
+}
+
+bool IsInputDependentAccess(Instruction *I, set<Value *> &setDependent) {
+
+    if (LoadInst *pLoad = dyn_cast<LoadInst>(I)) {
+        return setDependent.find(pLoad->getPointerOperand()) != setDependent.end();
+    }
+
+    if (StoreInst *pStore = dyn_cast<StoreInst>(I)) {
+        return setDependent.find(pStore->getPointerOperand()) != setDependent.end();
+    }
+
+    return true;
+}
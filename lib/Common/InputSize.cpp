@@ -0,0 +1,277 @@
+#include <set>
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include "Common/InputSize.h"
+
+using namespace llvm;
+using namespace std;
+
+
+struct SCEVUnknownCollector {
+
+    vector<Value *> &vecValues;
+
+    SCEVUnknownCollector(vector<Value *> &vec) : vecValues(vec) {}
+
+    bool follow(const SCEV *S) {
+        if (const SCEVUnknown *pUnknown = dyn_cast<SCEVUnknown>(S)) {
+            vecValues.push_back(pUnknown->getValue());
+        }
+        return true;
+    }
+
+    bool isDone() const {
+        return false;
+    }
+};
+
+/*
+ * Whether the memory pointed to by pPointer may be changed by any instruction of pLoop.
+ */
+bool IsWrittenInLoop(Value *pPointer, Loop *pLoop) {
+
+    const DataLayout &DL = pLoop->getHeader()->getModule()->getDataLayout();
+    Value *pObject = GetUnderlyingObject(pPointer, DL);
+    bool bLocal = isa<AllocaInst>(pObject) && !PointerMayBeCaptured(pObject, true, true);
+
+    for (Loop::block_iterator BB = pLoop->block_begin(); BB != pLoop->block_end(); BB++) {
+        for (BasicBlock::iterator II = (*BB)->begin(); II != (*BB)->end(); II++) {
+
+            if (!II->mayWriteToMemory()) {
+                continue;
+            }
+
+            if (StoreInst *pStore = dyn_cast<StoreInst>(II)) {
+                Value *pStoreObject = GetUnderlyingObject(pStore->getPointerOperand(), DL);
+                if (pStoreObject == pObject || !isIdentifiedObject(pStoreObject) || !isIdentifiedObject(pObject)) {
+                    return true;
+                }
+                continue;
+            }
+
+            // a call or an atomic can only reach a local variable through its operands
+            if (!bLocal) {
+                return true;
+            }
+
+            for (unsigned i = 0; i < II->getNumOperands(); i++) {
+                if (II->getOperand(i)->getType()->isPointerTy() &&
+                    GetUnderlyingObject(II->getOperand(i), DL) == pObject) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Whether V can be evaluated once before the first iteration of pLoop.
+ * Loads are only hoisted from the header, which runs on every entry, so a reload cannot fault.
+ */
+bool IsInvariantAtEntry(Value *V, Loop *pLoop, DominatorTree *DT) {
+
+    Instruction *I = dyn_cast<Instruction>(V);
+    if (!I) {
+        return true;
+    }
+
+    BasicBlock *pPreHeader = pLoop->getLoopPreheader();
+    if (pPreHeader == NULL) {
+        return false;
+    }
+
+    if (!pLoop->contains(I)) {
+        return DT->dominates(I->getParent(), pPreHeader);
+    }
+
+    if (LoadInst *pLoad = dyn_cast<LoadInst>(I)) {
+        if (I->getParent() != pLoop->getHeader() || pLoad->isVolatile()) {
+            return false;
+        }
+        return IsInvariantAtEntry(pLoad->getPointerOperand(), pLoop, DT) &&
+               !IsWrittenInLoop(pLoad->getPointerOperand(), pLoop);
+    }
+
+    if (isa<CastInst>(I) || isa<BinaryOperator>(I) || isa<GetElementPtrInst>(I) || isa<CmpInst>(I) ||
+        isa<SelectInst>(I)) {
+
+        if (!isSafeToSpeculativelyExecute(I)) {
+            return false;
+        }
+
+        for (unsigned i = 0; i < I->getNumOperands(); i++) {
+            if (!IsInvariantAtEntry(I->getOperand(i), pLoop, DT)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Follow the def-use chain of a bound back to what the loop was given: arguments, struct fields,
+ * call results. Local variables (O0 allocas) are followed through their stores.
+ */
+static void SearchInputRoots(Value *V, Loop *pLoop, DominatorTree *DT, set<Value *> &setVisited,
+                             vector<Value *> &vecRoots) {
+
+    if (!setVisited.insert(V).second) {
+        return;
+    }
+
+    // constants and global addresses are not sizes
+    if (isa<Constant>(V)) {
+        return;
+    }
+
+    if (isa<Argument>(V)) {
+        vecRoots.push_back(V);
+        return;
+    }
+
+    Instruction *I = dyn_cast<Instruction>(V);
+    if (!I) {
+        return;
+    }
+
+    if (LoadInst *pLoad = dyn_cast<LoadInst>(I)) {
+
+        AllocaInst *pAlloca = dyn_cast<AllocaInst>(pLoad->getPointerOperand()->stripPointerCasts());
+        bool bTracked = pAlloca != NULL;
+        vector<Value *> vecStored;
+
+        if (pAlloca) {
+            for (User *U : pAlloca->users()) {
+                if (isa<LoadInst>(U)) {
+                    continue;
+                }
+
+                StoreInst *pStore = dyn_cast<StoreInst>(U);
+                if (pStore && pStore->getPointerOperand() == pAlloca && !pLoop->contains(pStore)) {
+                    vecStored.push_back(pStore->getValueOperand());
+                    continue;
+                }
+
+                bTracked = false;
+                break;
+            }
+        }
+
+        if (bTracked) {
+            for (unsigned long i = 0; i < vecStored.size(); i++) {
+                SearchInputRoots(vecStored[i], pLoop, DT, setVisited, vecRoots);
+            }
+            return;
+        }
+
+        // a field, or a variable we cannot follow: the loaded value itself is the input
+        if (IsInvariantAtEntry(I, pLoop, DT)) {
+            vecRoots.push_back(I);
+        }
+        return;
+    }
+
+    if (isa<CastInst>(I) || isa<BinaryOperator>(I) || isa<GetElementPtrInst>(I) || isa<SelectInst>(I) ||
+        (isa<PHINode>(I) && !pLoop->contains(I))) {
+
+        for (unsigned i = 0; i < I->getNumOperands(); i++) {
+            SearchInputRoots(I->getOperand(i), pLoop, DT, setVisited, vecRoots);
+        }
+        return;
+    }
+
+    // calls and anything else computed before the loop are taken as they are
+    if (IsInvariantAtEntry(I, pLoop, DT)) {
+        vecRoots.push_back(I);
+    }
+}
+
+/*
+ * Values bounding the trip count of pLoop, or the region it scans: the leaves of the SCEV exit counts
+ * when SCEV can compute them, otherwise the loop-invariant operands of the exit conditions.
+ * Each bound is then traced back to the inputs of the loop.
+ */
+void SearchInputSizes(Loop *pLoop, ScalarEvolution *SE, DominatorTree *DT, vector<Value *> &vecInputs) {
+
+    vector<Value *> vecBounds;
+
+    SmallVector<BasicBlock *, 4> vecExiting;
+    pLoop->getExitingBlocks(vecExiting);
+
+    for (unsigned i = 0; i < vecExiting.size(); i++) {
+
+        const SCEV *pExitCount = SE->getExitCount(pLoop, vecExiting[i]);
+        if (!isa<SCEVCouldNotCompute>(pExitCount)) {
+            SCEVUnknownCollector Collector(vecBounds);
+            visitAll(pExitCount, Collector);
+            continue;
+        }
+
+        BranchInst *pBranch = dyn_cast<BranchInst>(vecExiting[i]->getTerminator());
+        if (!pBranch || !pBranch->isConditional()) {
+            continue;
+        }
+
+        ICmpInst *pCmp = dyn_cast<ICmpInst>(pBranch->getCondition());
+        if (!pCmp) {
+            continue;
+        }
+
+        for (unsigned j = 0; j < pCmp->getNumOperands(); j++) {
+            if (IsInvariantAtEntry(pCmp->getOperand(j), pLoop, DT)) {
+                vecBounds.push_back(pCmp->getOperand(j));
+            }
+        }
+    }
+
+    set<Value *> setVisited;
+    vector<Value *> vecRoots;
+
+    for (unsigned long i = 0; i < vecBounds.size(); i++) {
+        SearchInputRoots(vecBounds[i], pLoop, DT, setVisited, vecRoots);
+    }
+
+    set<Value *> setInputs;
+    for (unsigned long i = 0; i < vecRoots.size(); i++) {
+        Type *pType = vecRoots[i]->getType();
+        if ((pType->isIntegerTy() || pType->isPointerTy()) && setInputs.insert(vecRoots[i]).second) {
+            vecInputs.push_back(vecRoots[i]);
+        }
+    }
+}
+
+/*
+ * Re-evaluate a value accepted by IsInvariantAtEntry before InsertBefore, cloning the part computed in the loop.
+ */
+Value *MaterializeAtEntry(Value *V, Loop *pLoop, Instruction *InsertBefore) {
+
+    Instruction *I = dyn_cast<Instruction>(V);
+    if (!I || !pLoop->contains(I)) {
+        return V;
+    }
+
+    Instruction *pClone = I->clone();
+    for (unsigned i = 0; i < I->getNumOperands(); i++) {
+        pClone->setOperand(i, MaterializeAtEntry(I->getOperand(i), pLoop, InsertBefore));
+    }
+
+    if (I->hasName()) {
+        pClone->setName(I->getName() + ".CPI");
+    }
+    pClone->insertBefore(InsertBefore);
+
+    return pClone;
+}
@@ -0,0 +1,76 @@
+#include "Common/LibcModel.h"
+
+using namespace llvm;
+using namespace std;
+
+
+/*
+ * The ranges are those the call is allowed to touch, not the bytes it actually reads. Most are exact, but
+ * strcmp and strcasecmp stop at the first difference and the conversions at the first character that is not
+ * part of the number, and both are modelled on the whole string: an upper bound that overstates the RMS of
+ * an invocation comparing or parsing long strings. strstr is modelled up to the match.
+ */
+static const stLibcAccess LibcModels[] = {
+        // strings
+        {"strlen",         0, false, SIZE_STRING,           0, 0},
+        {"strnlen",        0, false, SIZE_RETURN,           0, 0},
+        {"strcmp",         0, false, SIZE_STRING,           0, 0},     // upper bound
+        {"strcmp",         1, false, SIZE_STRING,           0, 0},
+        {"strcasecmp",     0, false, SIZE_STRING,           0, 0},     // upper bound
+        {"strcasecmp",     1, false, SIZE_STRING,           0, 0},
+        {"strncmp",        0, false, SIZE_ARGUMENT,         2, 0},
+        {"strncmp",        1, false, SIZE_ARGUMENT,         2, 0},
+        {"strncasecmp",    0, false, SIZE_ARGUMENT,         2, 0},
+        {"strncasecmp",    1, false, SIZE_ARGUMENT,         2, 0},
+        {"strchr",         0, false, SIZE_RETURN_OFFSET,    0, 0},
+        {"strrchr",        0, false, SIZE_STRING,           0, 0},
+        {"strstr",         0, false, SIZE_RETURN_OFFSET,    0, 0},
+        {"strstr",         1, false, SIZE_STRING,           0, 0},
+        {"strcpy",         0, true,  SIZE_STRING,           0, 0},
+        {"strcpy",         1, false, SIZE_STRING,           0, 0},
+        {"strncpy",        0, true,  SIZE_ARGUMENT,         2, 0},
+        {"strncpy",        1, false, SIZE_ARGUMENT,         2, 0},
+        {"strcat",         0, true,  SIZE_STRING,           0, 0},
+        {"strcat",         1, false, SIZE_STRING,           0, 0},
+        {"strdup",         0, false, SIZE_STRING,           0, 0},
+        {"atoi",           0, false, SIZE_STRING,           0, 0},     // upper bound, and the conversions below
+        {"atol",           0, false, SIZE_STRING,           0, 0},
+        {"strtol",         0, false, SIZE_STRING,           0, 0},
+        {"strtoul",        0, false, SIZE_STRING,           0, 0},
+
+        // memory
+        {"memcmp",         0, false, SIZE_ARGUMENT,         2, 0},
+        {"memcmp",         1, false, SIZE_ARGUMENT,         2, 0},
+        {"memchr",         0, false, SIZE_RETURN_OFFSET_ARGUMENT, 2, 0},
+        {"memcpy",         0, true,  SIZE_ARGUMENT,         2, 0},
+        {"memcpy",         1, false, SIZE_ARGUMENT,         2, 0},
+        {"memmove",        0, true,  SIZE_ARGUMENT,         2, 0},
+        {"memmove",        1, false, SIZE_ARGUMENT,         2, 0},
+        {"memset",         0, true,  SIZE_ARGUMENT,         2, 0},
+        {"llvm.memcpy.",   0, true,  SIZE_ARGUMENT,         2, 0},
+        {"llvm.memcpy.",   1, false, SIZE_ARGUMENT,         2, 0},
+        {"llvm.memmove.",  0, true,  SIZE_ARGUMENT,         2, 0},
+        {"llvm.memmove.",  1, false, SIZE_ARGUMENT,         2, 0},
+        {"llvm.memset.",   0, true,  SIZE_ARGUMENT,         2, 0},
+
+        // streams, only the caller's buffers: the buffer of a FILE is not reachable
+        {"fgets",          0, true,  SIZE_ARGUMENT,         1, 0},
+        {"fread",          0, true,  SIZE_RETURN_PRODUCT,   1, 0},
+        {"fwrite",         0, false, SIZE_ARGUMENT_PRODUCT, 1, 2},
+        {"read",           1, true,  SIZE_RETURN,           0, 0},
+        {"recv",           1, true,  SIZE_RETURN,           0, 0},
+        {"write",          1, false, SIZE_ARGUMENT,         2, 0},
+        {"send",           1, false, SIZE_ARGUMENT,         2, 0},
+};
+
+void SearchLibcModel(StringRef sCalled, vector<const stLibcAccess *> &vecAccesses) {
+
+    for (unsigned i = 0; i < sizeof(LibcModels) / sizeof(LibcModels[0]); i++) {
+
+        StringRef sModel(LibcModels[i].sName);
+
+        if (sModel.endswith(".") ? sCalled.startswith(sModel) : sCalled == sModel) {
+            vecAccesses.push_back(&LibcModels[i]);
+        }
+    }
+}
@@ -268,7 +268,7 @@ std::set<Loop *> getSubLoopSet(Loop *lp) {
 
         if (loop != nullptr && !loop->empty()) {
 
-            std::vector<Loop *> &subloopVect = lp->getSubLoopsVector();
+            std::vector<Loop *> &subloopVect = loop->getSubLoopsVector();
             if (!subloopVect.empty()) {
                 for (std::vector<Loop *>::const_iterator SI = subloopVect.begin(); SI != subloopVect.end(); SI++) {
                     if (*SI != NULL) {
@@ -289,13 +289,14 @@ std::set<Loop *> getSubLoopSet(Loop *lp) {
 std::set<Loop *> getLoopSet(Loop *lp) {
     std::set<Loop *> LoopSet;
 
-    if (lp != NULL && lp->getHeader() != NULL && !lp->empty()) {
+    if (lp != NULL && lp->getHeader() != NULL) {
         LoopSet.insert(lp);
         const std::vector<Loop *> &subloopVect = lp->getSubLoops();
         if (!subloopVect.empty()) {
             for (std::vector<Loop *>::const_iterator subli = subloopVect.begin(); subli != subloopVect.end(); subli++) {
                 Loop *subloop = *subli;
-                getLoopSet(subloop);
+                std::set<Loop *> SubLoopSet = getLoopSet(subloop);
+                LoopSet.insert(SubLoopSet.begin(), SubLoopSet.end());
             }
         }
     }
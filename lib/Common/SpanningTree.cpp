@@ -0,0 +1,272 @@
+#include <algorithm>
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+#include "Common/Helper.h"
+#include "Common/SpanningTree.h"
+
+using namespace llvm;
+using namespace std;
+
+
+/*
+ * Cost of one execution of BB: the cost tagged by the cost pass if any,
+ * otherwise the number of instructions (PHIs and debug intrinsics excluded).
+ */
+int GetBlockCost(BasicBlock *BB) {
+
+    int iCost = GetBBCostNum(BB);
+    if (iCost >= 0) {
+        return iCost;
+    }
+
+    iCost = 0;
+    for (BasicBlock::iterator II = BB->begin(); II != BB->end(); II++) {
+        if (isa<PHINode>(II) || isa<DbgInfoIntrinsic>(II)) {
+            continue;
+        }
+        iCost++;
+    }
+
+    return iCost;
+}
+
+/*
+ * Static frequency of every CFG edge of F, edges leaving F (ret, unreachable, resume) are keyed by (BB, NULL).
+ * The analyses are built locally, so that the on-the-fly pass manager does not release the LoopInfo of the caller.
+ */
+void GetEdgeFrequencies(Function *F, LoopInfo *pLI, map<pair<BasicBlock *, BasicBlock *>, uint64_t> &mapEdgeFreq) {
+
+    DominatorTree DT(*F);
+    LoopInfo LocalLI(DT);
+
+    if (pLI == NULL) {
+        pLI = &LocalLI;
+    }
+
+    BranchProbabilityInfo BPI(*F, *pLI);
+    BlockFrequencyInfo BFI(*F, BPI, *pLI);
+
+    for (Function::iterator BI = F->begin(); BI != F->end(); BI++) {
+
+        BasicBlock *BB = &*BI;
+        BlockFrequency Freq = BFI.getBlockFreq(BB);
+        TerminatorInst *pTerm = BB->getTerminator();
+
+        if (pTerm->getNumSuccessors() == 0) {
+            mapEdgeFreq[make_pair(BB, (BasicBlock *) NULL)] += Freq.getFrequency();
+            continue;
+        }
+
+        for (unsigned i = 0; i < pTerm->getNumSuccessors(); i++) {
+            BlockFrequency EdgeFreq = Freq * BPI.getEdgeProbability(BB, i);
+            mapEdgeFreq[make_pair(BB, pTerm->getSuccessor(i))] += EdgeFreq.getFrequency();
+        }
+    }
+}
+
+/*
+ * Expected cost of one call to F, each block weighted by its static frequency relative to the entry.
+ */
+long GetExpectedFunctionCost(Function *F) {
+
+    DominatorTree DT(*F);
+    LoopInfo LI(DT);
+    BranchProbabilityInfo BPI(*F, LI);
+    BlockFrequencyInfo BFI(*F, BPI, LI);
+
+    uint64_t uEntryFreq = BFI.getEntryFreq();
+    if (uEntryFreq == 0) {
+        return 0;
+    }
+
+    double dCost = 0;
+    for (Function::iterator BB = F->begin(); BB != F->end(); BB++) {
+        dCost += (double) GetBlockCost(&*BB) * BFI.getBlockFreq(&*BB).getFrequency() / uEntryFreq;
+    }
+
+    return (long) dCost;
+}
+
+static unsigned FindRoot(vector<unsigned> &vecParent, unsigned uNode) {
+
+    while (vecParent[uNode] != uNode) {
+        vecParent[uNode] = vecParent[vecParent[uNode]];
+        uNode = vecParent[uNode];
+    }
+
+    return uNode;
+}
+
+// an edge to an EH pad cannot be split, so it cannot hold a counter
+static bool IsUnwindEdge(const stCostEdge &Edge) {
+
+    return Edge.pDst != NULL && Edge.pDst->isEHPad();
+}
+
+/*
+ * Kruskal on the undirected region graph, hottest edges first, so that counters end up on the cold chords.
+ * Unwind edges come before all of them, as if of maximal weight, and all get into the tree: they could only
+ * close a cycle among themselves if an EH pad unwound back to itself.
+ * The virtual edge is executed exactly once per region entry, it is always a chord and its increment is
+ * folded into the counter reset.
+ */
+void BuildMaxSpanningTree(vector<stCostEdge> &vecEdges) {
+
+    map<BasicBlock *, unsigned> mapNodeIndex;
+    mapNodeIndex[NULL] = 0;
+
+    vector<unsigned> vecOrder;
+
+    for (unsigned i = 0; i < vecEdges.size(); i++) {
+
+        if (mapNodeIndex.find(vecEdges[i].pSrc) == mapNodeIndex.end()) {
+            unsigned uIndex = mapNodeIndex.size();
+            mapNodeIndex[vecEdges[i].pSrc] = uIndex;
+        }
+
+        if (mapNodeIndex.find(vecEdges[i].pDst) == mapNodeIndex.end()) {
+            unsigned uIndex = mapNodeIndex.size();
+            mapNodeIndex[vecEdges[i].pDst] = uIndex;
+        }
+
+        vecEdges[i].bChord = true;
+        if (vecEdges[i].pSrc != NULL) {
+            vecOrder.push_back(i);
+        }
+    }
+
+    stable_sort(vecOrder.begin(), vecOrder.end(), [&vecEdges](unsigned a, unsigned b) {
+        if (IsUnwindEdge(vecEdges[a]) != IsUnwindEdge(vecEdges[b])) {
+            return IsUnwindEdge(vecEdges[a]);
+        }
+        return vecEdges[a].uFreq > vecEdges[b].uFreq;
+    });
+
+    vector<unsigned> vecParent(mapNodeIndex.size());
+    for (unsigned i = 0; i < vecParent.size(); i++) {
+        vecParent[i] = i;
+    }
+
+    for (unsigned i = 0; i < vecOrder.size(); i++) {
+
+        stCostEdge &Edge = vecEdges[vecOrder[i]];
+        unsigned uSrcRoot = FindRoot(vecParent, mapNodeIndex[Edge.pSrc]);
+        unsigned uDstRoot = FindRoot(vecParent, mapNodeIndex[Edge.pDst]);
+
+        if (uSrcRoot != uDstRoot) {
+            vecParent[uSrcRoot] = uDstRoot;
+            Edge.bChord = false;
+        }
+    }
+}
+
+/*
+ * cost = sum(count(e) * cost(dst(e))). Every tree edge count is a signed sum of the chord counts on the
+ * fundamental cycles through it, so the cost is exactly sum(count(c) * increment(c)) over the chords,
+ * where increment(c) is the signed cost around the fundamental cycle of c.
+ */
+void ComputeChordIncrements(vector<stCostEdge> &vecEdges, map<BasicBlock *, int> &mapBlockCost) {
+
+    map<BasicBlock *, vector<unsigned> > mapTreeAdj;
+
+    for (unsigned i = 0; i < vecEdges.size(); i++) {
+        if (!vecEdges[i].bChord) {
+            mapTreeAdj[vecEdges[i].pSrc].push_back(i);
+            mapTreeAdj[vecEdges[i].pDst].push_back(i);
+        }
+    }
+
+    // root every tree component, the virtual node first
+    map<BasicBlock *, int> mapParentEdge;
+    map<BasicBlock *, unsigned> mapDepth;
+    vector<BasicBlock *> vecRoots;
+    vecRoots.push_back(NULL);
+
+    for (unsigned i = 0; i < vecEdges.size(); i++) {
+        vecRoots.push_back(vecEdges[i].pSrc);
+        vecRoots.push_back(vecEdges[i].pDst);
+    }
+
+    for (unsigned r = 0; r < vecRoots.size(); r++) {
+
+        if (mapDepth.find(vecRoots[r]) != mapDepth.end()) {
+            continue;
+        }
+
+        mapDepth[vecRoots[r]] = 0;
+        mapParentEdge[vecRoots[r]] = -1;
+
+        vector<BasicBlock *> vecWorkList;
+        vecWorkList.push_back(vecRoots[r]);
+
+        while (!vecWorkList.empty()) {
+
+            BasicBlock *pNode = vecWorkList.back();
+            vecWorkList.pop_back();
+
+            vector<unsigned> &vecAdj = mapTreeAdj[pNode];
+            for (unsigned i = 0; i < vecAdj.size(); i++) {
+
+                stCostEdge &Edge = vecEdges[vecAdj[i]];
+                BasicBlock *pNext = Edge.pSrc == pNode ? Edge.pDst : Edge.pSrc;
+
+                if (mapDepth.find(pNext) != mapDepth.end()) {
+                    continue;
+                }
+
+                mapDepth[pNext] = mapDepth[pNode] + 1;
+                mapParentEdge[pNext] = vecAdj[i];
+                vecWorkList.push_back(pNext);
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < vecEdges.size(); i++) {
+
+        stCostEdge &Chord = vecEdges[i];
+        if (!Chord.bChord) {
+            continue;
+        }
+
+        long lIncrement = Chord.pDst ? mapBlockCost[Chord.pDst] : 0;
+
+        // the cycle runs Chord.pSrc -> Chord.pDst, then back along the tree from pDst (x) to pSrc (y)
+        BasicBlock *x = Chord.pDst;
+        BasicBlock *y = Chord.pSrc;
+
+        while (x != y) {
+
+            if (mapDepth[x] >= mapDepth[y]) {
+
+                int iEdge = mapParentEdge[x];
+                if (iEdge < 0) {
+                    break;
+                }
+                // walking up from x: the cycle goes x -> parent
+                stCostEdge &Edge = vecEdges[iEdge];
+                long lCost = Edge.pDst ? mapBlockCost[Edge.pDst] : 0;
+                lIncrement += Edge.pSrc == x ? lCost : -lCost;
+                x = Edge.pSrc == x ? Edge.pDst : Edge.pSrc;
+
+            } else {
+
+                int iEdge = mapParentEdge[y];
+                if (iEdge < 0) {
+                    break;
+                }
+                // walking up from y: the cycle goes parent -> y
+                stCostEdge &Edge = vecEdges[iEdge];
+                long lCost = Edge.pDst ? mapBlockCost[Edge.pDst] : 0;
+                lIncrement += Edge.pDst == y ? lCost : -lCost;
+                y = Edge.pSrc == y ? Edge.pDst : Edge.pSrc;
+            }
+        }
+
+        Chord.lIncrement = lIncrement;
+    }
+}
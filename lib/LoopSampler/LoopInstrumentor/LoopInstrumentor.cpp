@@ -2,15 +2,21 @@
 // Clonesample Pass demo.
 //
 
+#include "llvm/Analysis/AssumptionCache.h"
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
@@ -22,8 +28,16 @@
 #include "LoopSampler/LoopInstrumentor/LoopInstrumentor.h"
 #include "Common/ArrayLinkedIndentifier.h"
 #include "Common/Constant.h"
+#include "Common/Helper.h"
+#include "Common/InputDependence.h"
+#include "Common/InputSize.h"
+#include "Common/LibcModel.h"
 #include "Common/Loop.h"
+#include "Common/SpanningTree.h"
 
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 #include <stdlib.h>
 
 using namespace llvm;
@@ -47,16 +61,84 @@ static cl::opt<std::string> strFuncName("strFunc",
 static cl::opt<bool> bElseIf("bElseIf", cl::desc("use if-elseif-else instead of if-else"), cl::Optional,
                              cl::value_desc("bElseIf"), cl::init(false));
 
+static cl::opt<bool> bCost("bCost", cl::desc("count the cost of each sampled invocation"), cl::Optional,
+                           cl::value_desc("bCost"), cl::init(false));
+
+static cl::opt<bool> bCounterOnly("bCounterOnly",
+                                  cl::desc("only record the trip count and the input sizes, no memory access"),
+                                  cl::Optional, cl::value_desc("bCounterOnly"), cl::init(false));
+
+static cl::list<std::string> strInputSize("inputSize",
+                                          cl::desc("Variables recorded as input sizes at each sampled invocation"),
+                                          cl::CommaSeparated, cl::value_desc("strInputSize"));
+
+static cl::opt<bool> bAutoInputSize("bAutoInputSize",
+                                    cl::desc("record the loop-invariant values bounding the loop as input sizes"),
+                                    cl::Optional, cl::value_desc("bAutoInputSize"), cl::init(false));
+
+static cl::opt<bool> bInputDependentOnly("bInputDependentOnly",
+                                         cl::desc("only hook the accesses whose address derives from the loop inputs"),
+                                         cl::Optional, cl::value_desc("bInputDependentOnly"), cl::init(false));
+
+static cl::opt<bool> bNestedMarkers("bNestedMarkers",
+                                    cl::desc("mark each iteration of the sampled loop and of the loops nested in it"),
+                                    cl::Optional, cl::value_desc("bNestedMarkers"), cl::init(false));
+
+static cl::opt<bool> bFunctionDispatch("bFunctionDispatch",
+                                       cl::desc("clone the whole function of the loop and sample once per call"),
+                                       cl::Optional, cl::value_desc("bFunctionDispatch"), cl::init(false));
+
+static cl::opt<bool> bRecursive("bRecursive",
+                                cl::desc("sample the top-level invocations of the recursive function strFunc"),
+                                cl::Optional, cl::value_desc("bRecursive"), cl::init(false));
+
+static cl::opt<bool> bCacheLine("bCacheLine",
+                                cl::desc("record loads and stores as cache lines, dropping repeats of the same line at each site"),
+                                cl::Optional, cl::value_desc("bCacheLine"), cl::init(false));
+
+static cl::opt<bool> bCoalesce("bCoalesce",
+                               cl::desc("merge adjacent loads and stores of a site into one record in the runtime"),
+                               cl::Optional, cl::value_desc("bCoalesce"), cl::init(false));
+
+static cl::opt<bool> bDistinct("bDistinct",
+                               cl::desc("record only the first load and store of each address in a sampled invocation"),
+                               cl::Optional, cl::value_desc("bDistinct"), cl::init(false));
+
+static cl::opt<bool> bAlloc("bAlloc",
+                            cl::desc("record the heap allocations made in sampled invocations, link with AllocLib"),
+                            cl::Optional, cl::value_desc("bAlloc"), cl::init(false));
+
+static cl::opt<unsigned> uMaxCloneDepth("maxCloneDepth",
+                                        cl::desc("callees deeper than this in the call graph of the loop are not cloned, 0 for no limit"),
+                                        cl::Optional, cl::value_desc("uMaxCloneDepth"), cl::init(0));
+
+static cl::opt<unsigned> uMaxCloneSize("maxCloneSize",
+                                       cl::desc("budget in instructions for the cloned callees, 0 for no limit"),
+                                       cl::Optional, cl::value_desc("uMaxCloneSize"), cl::init(0));
+
+static cl::opt<std::string> strIndirectProfile("indirectProfile",
+                                               cl::desc("value profile of indirect calls: one \"ins_id target count\" per line, "
+                                                        "as written by TraceAnalyzer -p"),
+                                               cl::Optional, cl::value_desc("strIndirectProfile"));
+
+static cl::opt<unsigned> uMaxPromotedTargets("maxPromotedTargets",
+                                             cl::desc("hottest targets promoted at each indirect call site"),
+                                             cl::Optional, cl::value_desc("uMaxPromotedTargets"), cl::init(2));
+
 char LoopInstrumentor::ID = 0;
 
 void LoopInstrumentor::getAnalysisUsage(AnalysisUsage &AU) const {
     AU.setPreservesAll();
     AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+    AU.addRequired<AssumptionCacheTracker>();
 }
 
 LoopInstrumentor::LoopInstrumentor() : ModulePass(ID) {
     PassRegistry &Registry = *PassRegistry::getPassRegistry();
     initializeLoopInfoWrapperPassPass(Registry);
+    initializeTargetLibraryInfoWrapperPassPass(Registry);
+    initializeAssumptionCacheTrackerPass(Registry);
 }
 
 void LoopInstrumentor::SetupTypes() {
@@ -80,7 +162,9 @@ void LoopInstrumentor::SetupStructs() {
     struct_fields.clear();
     struct_fields.push_back(this->LongType);  // address
     struct_fields.push_back(this->IntType);   // length
-    // 0: end; 1: delimiter; 2: load; 3: store; 4: memcpy; 5: memmove
+    // 0: end; 1: delimiter; 2: load; 3: store; 4: memcpy; 5: memmove; 6: cost (in address);
+    // 7: trip count (in address); 8: input size (value in address, input index in length)
+    // the rest is listed in runtime/include/Record.h
     struct_fields.push_back(this->IntType);   // flag
     if (this->struct_stMemRecord->isOpaque()) {
         this->struct_stMemRecord->setBody(struct_fields, false);
@@ -95,13 +179,23 @@ void LoopInstrumentor::SetupConstants() {
     this->ConstantLong10 = ConstantInt::get(pModule->getContext(), APInt(64, StringRef("10"), 10));
     this->ConstantLong16 = ConstantInt::get(pModule->getContext(), APInt(64, StringRef("16"), 10));
 
-    // int: -1, 0, 1, 2, 3, 4
+    // int: -1, 0, 1, 2, 3, 4, 5, 6, 7, 8
     this->ConstantIntN1 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("-1"), 10));
     this->ConstantInt0 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("0"), 10));
     this->ConstantInt1 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("1"), 10));
     this->ConstantInt2 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("2"), 10));
     this->ConstantInt3 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("3"), 10));
     this->ConstantInt4 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("4"), 10));
+    this->ConstantInt5 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("5"), 10));
+    this->ConstantInt6 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("6"), 10));
+    this->ConstantInt7 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("7"), 10));
+    this->ConstantInt8 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("8"), 10));
+    this->ConstantInt9 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("9"), 10));
+    this->ConstantInt10 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("10"), 10));
+    this->ConstantInt11 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("11"), 10));
+    this->ConstantInt15 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("15"), 10));
+    this->ConstantInt16 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("16"), 10));
+    this->ConstantInt17 = ConstantInt::get(pModule->getContext(), APInt(32, StringRef("17"), 10));
 
     // bool: false
     this->ConstantIntFalse = ConstantInt::get(pModule->getContext(), APInt(1, StringRef("0"), 10));
@@ -123,6 +217,20 @@ void LoopInstrumentor::SetupGlobals() {
     this->numGlobalCounter->setAlignment(4);
     this->numGlobalCounter->setInitializer(this->ConstantInt0);
 
+    // long numGlobalCost = 0;
+    assert(pModule->getGlobalVariable("numGlobalCost") == NULL);
+    this->numGlobalCost = new GlobalVariable(*pModule, this->LongType, false, GlobalValue::ExternalLinkage, 0,
+                                             "numGlobalCost");
+    this->numGlobalCost->setAlignment(8);
+    this->numGlobalCost->setInitializer(this->ConstantLong0);
+
+    // long numGlobalIteration = 0;
+    assert(pModule->getGlobalVariable("numGlobalIteration") == NULL);
+    this->numGlobalIteration = new GlobalVariable(*pModule, this->LongType, false, GlobalValue::ExternalLinkage, 0,
+                                                  "numGlobalIteration");
+    this->numGlobalIteration->setAlignment(8);
+    this->numGlobalIteration->setInitializer(this->ConstantLong0);
+
     // int SAMPLE_RATE = 0;
     assert(pModule->getGlobalVariable("SAMPLE_RATE") == NULL);
     this->SAMPLE_RATE = new GlobalVariable(*pModule, this->IntType, false, GlobalValue::CommonLinkage, 0,
@@ -144,6 +252,15 @@ void LoopInstrumentor::SetupGlobals() {
     this->iBufferIndex_CPI->setAlignment(8);
     this->iBufferIndex_CPI->setInitializer(this->ConstantLong0);
 
+    // __thread int iSampling_CPI = 0, read by the allocation hooks of AllocLib
+    this->iSampling_CPI = NULL;
+    if (bAlloc) {
+        this->iSampling_CPI = new GlobalVariable(*pModule, this->IntType, false, GlobalValue::ExternalLinkage,
+                                                 this->ConstantInt0, "iSampling_CPI", NULL,
+                                                 GlobalVariable::GeneralDynamicTLSModel);
+        this->iSampling_CPI->setAlignment(4);
+    }
+
     // struct_stLogRecord Record_CPI
     assert(pModule->getGlobalVariable("Record_CPI") == NULL);
     this->Record_CPI = new GlobalVariable(*pModule, this->struct_stMemRecord, false, GlobalValue::ExternalLinkage, 0,
@@ -192,6 +309,17 @@ void LoopInstrumentor::SetupFunctions() {
         ArgTypes.clear();
     }
 
+    // strlen, for the string ranges of the libc models
+    this->function_strlen = pModule->getFunction("strlen");
+    if (!this->function_strlen) {
+        ArgTypes.clear();
+        ArgTypes.push_back(this->CharStarType);
+        FunctionType *strlen_FuncTy = FunctionType::get(this->LongType, ArgTypes, false);
+        this->function_strlen = Function::Create(strlen_FuncTy, GlobalValue::ExternalLinkage, "strlen", pModule);
+        this->function_strlen->setCallingConv(CallingConv::C);
+        ArgTypes.clear();
+    }
+
     // func_llvm_memcpy
     this->func_llvm_memcpy = pModule->getFunction("llvm.memcpy.p0i8.p0i8.i64");
     if (!this->func_llvm_memcpy) {
@@ -260,6 +388,62 @@ void LoopInstrumentor::SetupFunctions() {
         ArgTypes.clear();
     }
 
+    // GetThreadID
+    this->GetThreadID = this->pModule->getFunction("GetThreadID");
+    if (!this->GetThreadID) {
+        FunctionType *GetThreadID_FuncTy = FunctionType::get(this->IntType, ArgTypes, false);
+        this->GetThreadID = Function::Create(GetThreadID_FuncTy, GlobalValue::ExternalLinkage, "GetThreadID",
+                                             this->pModule);
+        this->GetThreadID->setCallingConv(CallingConv::C);
+        ArgTypes.clear();
+    }
+
+    // CoalesceAccess
+    this->CoalesceAccess = this->pModule->getFunction("CoalesceAccess");
+    if (!this->CoalesceAccess) {
+        ArgTypes.push_back(this->LongType);
+        ArgTypes.push_back(this->IntType);
+        ArgTypes.push_back(this->IntType);
+        FunctionType *CoalesceAccess_FuncTy = FunctionType::get(this->VoidType, ArgTypes, false);
+        this->CoalesceAccess = Function::Create(CoalesceAccess_FuncTy, GlobalValue::ExternalLinkage,
+                                                "CoalesceAccess", this->pModule);
+        this->CoalesceAccess->setCallingConv(CallingConv::C);
+        ArgTypes.clear();
+    }
+
+    // FlushAccesses
+    this->FlushAccesses = this->pModule->getFunction("FlushAccesses");
+    if (!this->FlushAccesses) {
+        FunctionType *FlushAccesses_FuncTy = FunctionType::get(this->VoidType, ArgTypes, false);
+        this->FlushAccesses = Function::Create(FlushAccesses_FuncTy, GlobalValue::ExternalLinkage,
+                                               "FlushAccesses", this->pModule);
+        this->FlushAccesses->setCallingConv(CallingConv::C);
+        ArgTypes.clear();
+    }
+
+    // FilterAccess
+    this->FilterAccess = this->pModule->getFunction("FilterAccess");
+    if (!this->FilterAccess) {
+        ArgTypes.push_back(this->LongType);
+        ArgTypes.push_back(this->IntType);
+        ArgTypes.push_back(this->IntType);
+        FunctionType *FilterAccess_FuncTy = FunctionType::get(this->VoidType, ArgTypes, false);
+        this->FilterAccess = Function::Create(FilterAccess_FuncTy, GlobalValue::ExternalLinkage, "FilterAccess",
+                                              this->pModule);
+        this->FilterAccess->setCallingConv(CallingConv::C);
+        ArgTypes.clear();
+    }
+
+    // ResetFilter
+    this->ResetFilter = this->pModule->getFunction("ResetFilter");
+    if (!this->ResetFilter) {
+        FunctionType *ResetFilter_FuncTy = FunctionType::get(this->VoidType, ArgTypes, false);
+        this->ResetFilter = Function::Create(ResetFilter_FuncTy, GlobalValue::ExternalLinkage, "ResetFilter",
+                                             this->pModule);
+        this->ResetFilter->setCallingConv(CallingConv::C);
+        ArgTypes.clear();
+    }
+
     // FinalizeMemHooks
     this->FinalizeMemHooks = this->pModule->getFunction("FinalizeMemHooks");
     if (!this->FinalizeMemHooks) {
@@ -356,6 +540,7 @@ void LoopInstrumentor::InstrumentMain() {
 
             // Instrument FinalizeMemHooks before return.
             if (ReturnInst *pRet = dyn_cast<ReturnInst>(II)) {
+                InlineFlushAccesses(pRet);
                 LoadInst *pLoad = new LoadInst(this->iBufferIndex_CPI, "", false, pRet);
                 pLoad->setAlignment(8);
                 pCall = CallInst::Create(this->FinalizeMemHooks, pLoad, "", pRet);
@@ -372,6 +557,7 @@ void LoopInstrumentor::InstrumentMain() {
                 // Instrument FinalizeMemHooks before calling exit or functions similar to exit.
                 // TODO: any other functions similar to exit?
                 if (pCalled->getName() == "exit" || pCalled->getName() == "_ZL9mysql_endi") {
+                    InlineFlushAccesses(&*II);
                     pCall = CallInst::Create(this->FinalizeMemHooks, "", &*II);
                     pCall->setCallingConv(CallingConv::C);
                     pCall->setTailCall(false);
@@ -394,6 +580,12 @@ void LoopInstrumentor::SetupInit(Module &M) {
 
 bool LoopInstrumentor::runOnModule(Module &M) {
 
+    // each access goes through one hook, the modes do not stack
+    if ((int)bCacheLine + (int)bCoalesce + (int)bDistinct > 1) {
+        errs() << "-bCacheLine, -bCoalesce and -bDistinct cannot be combined\n";
+        return false;
+    }
+
     SetupInit(M);
 
     Function *pFunction = searchFunctionByName(M, strFileName, strFuncName, uSrcLine);
@@ -402,16 +594,36 @@ bool LoopInstrumentor::runOnModule(Module &M) {
         return false;
     }
 
+    if (!strIndirectProfile.empty()) {
+        LoadIndirectProfile(strIndirectProfile);
+    }
+
+    if (bRecursive) {
+        InstrumentMain();
+        InstrumentRecursiveFunction(pFunction);
+        InitLineSlots();
+        return false;
+    }
+
     LoopInfo &LoopInfo = getAnalysis<LoopInfoWrapperPass>(*pFunction).getLoopInfo();
+
+    if (bFunctionDispatch) {
+        InstrumentMain();
+        InstrumentFunctionDispatch(pFunction, &LoopInfo);
+        InitLineSlots();
+        return false;
+    }
+
     Loop *pLoop = searchLoopByLineNo(pFunction, &LoopInfo, uSrcLine);
 
     InstrumentMain();
-    InstrumentInnerLoop(pLoop, NULL);
+    InstrumentInnerLoop(pLoop, &LoopInfo);
+    InitLineSlots();
 
     return false;
 }
 
-void LoopInstrumentor::InstrumentInnerLoop(Loop *pInnerLoop, PostDominatorTree *PDT) {
+void LoopInstrumentor::InstrumentInnerLoop(Loop *pInnerLoop, LoopInfo *pLI) {
 
     set<BasicBlock *> setBlocksInLoop;
     for (Loop::block_iterator BB = pInnerLoop->block_begin(); BB != pInnerLoop->block_end(); BB++) {
@@ -420,9 +632,61 @@ void LoopInstrumentor::InstrumentInnerLoop(Loop *pInnerLoop, PostDominatorTree *
 
     ValueToValueMapTy VCalleeMap;
     map<Function *, set<Instruction *> > FuncCallSiteMapping;
+    set<Function *> setSummarizedCallee;
+
+    // static edge frequencies of the loop, taken before the CFG is changed
+    map<pair<BasicBlock *, BasicBlock *>, uint64_t> mapEdgeFreq;
+    if (bCost) {
+        GetEdgeFrequencies(pInnerLoop->getHeader()->getParent(), pLI, mapEdgeFreq);
+    }
+
+    // add hooks to function called inside the loop, only the cost is counted there in counter-only mode
+    if (!bCounterOnly || bCost) {
+        CloneFunctionCalled(setBlocksInLoop, VCalleeMap, FuncCallSiteMapping, setSummarizedCallee);
+    }
+
+    // cost edges of the callees are taken from the raw functions, before any hook is added
+    map<Function *, vector<stCostEdge> > mapCalleeCostEdges;
+    vector<Function *> vecClonedCallee;
 
-    // add hooks to function called inside the loop
-    CloneFunctionCalled(setBlocksInLoop, VCalleeMap, FuncCallSiteMapping);
+    for (map<Function *, set<Instruction *> >::iterator itMap = FuncCallSiteMapping.begin();
+         itMap != FuncCallSiteMapping.end(); itMap++) {
+
+        ValueToValueMapTy::iterator FuncIt = VCalleeMap.find(itMap->first);
+        if (FuncIt == VCalleeMap.end()) {
+            continue;
+        }
+
+        Function *pClonedCallee = cast<Function>(FuncIt->second);
+        vecClonedCallee.push_back(pClonedCallee);
+
+        if (bCost) {
+            CollectCalleeCostEdges(itMap->first, VCalleeMap, mapCalleeCostEdges[pClonedCallee]);
+        }
+    }
+
+    // the trip count and the input sizes are searched while SCEV still sees the original CFG,
+    // the trip count is expanded in the preheader, then moved to the cloned body
+    vector<Instruction *> vecTripCount;
+    Value *pTripCount = NULL;
+    vector<Value *> vecAutoInputSize;
+
+    if (bCounterOnly || bAutoInputSize) {
+        // built locally, getAnalysis on a function would release the LoopInfo we hold
+        Function *pFunction = pInnerLoop->getHeader()->getParent();
+        TargetLibraryInfo &TLI = getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
+        AssumptionCache &AC = getAnalysis<AssumptionCacheTracker>().getAssumptionCache(*pFunction);
+        DominatorTree DT(*pFunction);
+        ScalarEvolution SE(*pFunction, TLI, AC, DT, *pLI);
+
+        if (bAutoInputSize) {
+            SearchInputSizes(pInnerLoop, &SE, &DT, vecAutoInputSize);
+        }
+
+        if (bCounterOnly) {
+            pTripCount = ExpandTripCount(pInnerLoop, SE, vecTripCount);
+        }
+    }
 
     // created auxiliary basic block
     vector<BasicBlock *> vecAdd;
@@ -438,183 +702,1026 @@ void LoopInstrumentor::InstrumentInnerLoop(Loop *pInnerLoop, PostDominatorTree *
 
     CloneInnerLoop(pInnerLoop, vecAdd, VMap, vecCloned);
 
-    // instrument RecordMemHooks to clone loop
-    InstrumentRecordMemHooks(vecCloned);
+    RemapCalledFunction(vecCloned, VCalleeMap);
 
-    // inline delimit
-    BasicBlock *pClonedBody = vecAdd[2];
-    Instruction *pFirstInst = pClonedBody->getFirstNonPHI();
+    vector<BasicBlock *> vecExitCPI;
+    SplitClonedLoopExits(pInnerLoop, VMap, vecExitCPI);
 
-    InlineHookDelimit(pFirstInst);
-}
+    vector<stCostEdge> vecLoopCostEdges;
+    if (bCost) {
+        CollectLoopCostEdges(pInnerLoop, VMap, mapEdgeFreq, vecLoopCostEdges);
+    }
 
-void LoopInstrumentor::CreateIfElseBlock(Loop *pInnerLoop, std::vector<BasicBlock *> &vecAdded) {
-    /*
-     * If (counter == 0) {              // condition1
-     *      counter = gen_random();     // ifBody
-     *      // while                    //      cloneBody (to be instrumented)
-     * } else {
-     *      counter--;                  // elseBody
-     *      // while                    //      header (original code, no instrumented)
-     * }
-     */
+    // accesses to locals and globals the inputs never reach are loop bookkeeping, not worth a record
+    if (bInputDependentOnly && !bCounterOnly) {
+        set<BasicBlock *> setClonedBlocks(vecCloned.begin(), vecCloned.end());
+        SearchInputDependentValues(setClonedBlocks, vecClonedCallee, this->setInputDependent);
+    }
 
-    BasicBlock *pCondition1 = NULL;
+    if (!bCounterOnly) {
+        // instrument RecordMemHooks to clone loop
+        InstrumentAccesses(vecCloned);
 
-    BasicBlock *pIfBody = NULL;
-    BasicBlock *pElseBody = NULL;
-    BasicBlock *pClonedBody = NULL;
+        // and to the cloned callees
+        for (unsigned long i = 0; i < vecClonedCallee.size(); i++) {
+            vector<BasicBlock *> vecCalleeBlocks;
+            for (Function::iterator BB = vecClonedCallee[i]->begin(); BB != vecClonedCallee[i]->end(); BB++) {
+                vecCalleeBlocks.push_back(&*BB);
+            }
+            InstrumentAccesses(vecCalleeBlocks);
+        }
+    }
 
-    LoadInst *pLoad1 = NULL;
-    LoadInst *pLoad2 = NULL;
+    // callees left out by the clone limits run raw, their calls are summarized instead
+    if (!setSummarizedCallee.empty()) {
+        InstrumentCalleeSummary(vecCloned, setSummarizedCallee);
 
-    ICmpInst *pCmp = NULL;
+        for (unsigned long i = 0; i < vecClonedCallee.size(); i++) {
+            vector<BasicBlock *> vecCalleeBlocks;
+            for (Function::iterator BB = vecClonedCallee[i]->begin(); BB != vecClonedCallee[i]->end(); BB++) {
+                vecCalleeBlocks.push_back(&*BB);
+            }
+            InstrumentCalleeSummary(vecCalleeBlocks, setSummarizedCallee);
+        }
+    }
 
-    BinaryOperator *pBinary = NULL;
-    TerminatorInst *pTerminator = NULL;
-    BranchInst *pBranch = NULL;
-    StoreInst *pStore = NULL;
-    CallInst *pCall = NULL;
-    AttributeList emptySet;
+    // inline delimit
+    BasicBlock *pClonedBody = vecAdd[2];
+    Instruction *pFirstInst = pClonedBody->getFirstNonPHI();
 
-    Function *pInnerFunction = pInnerLoop->getHeader()->getParent();
-    Module *pModule = pInnerFunction->getParent();
+    InlineHookDelimit(pFirstInst, GetLoopID(pInnerLoop));
 
-    pCondition1 = pInnerLoop->getLoopPreheader();
-    BasicBlock *pHeader = pInnerLoop->getHeader();
+    for (unsigned long i = 0; i < vecExitCPI.size(); i++) {
+        InlineSetSampling(this->ConstantInt0, vecExitCPI[i]->getTerminator());
+    }
 
-    pIfBody = BasicBlock::Create(pModule->getContext(), ".if.body.CPI", pInnerFunction, 0);
-    // Contains original code, thus no CPI
-    pElseBody = BasicBlock::Create(pModule->getContext(), ".else.body", pInnerFunction, 0);
-    // Cloned code, added to ifBody and elseIfBody
-    pClonedBody = BasicBlock::Create(pModule->getContext(), ".cloned.body.CPI", pInnerFunction, 0);
+    if (bNestedMarkers) {
+        InstrumentNestedMarkers(pInnerLoop, VMap);
+    }
 
-    pTerminator = pCondition1->getTerminator();
+    // input sizes are recorded once per sampled invocation, right after the delimiter
+    Function *pFunction = pInnerLoop->getHeader()->getParent();
+    for (unsigned i = 0; i < strInputSize.size(); i++) {
+        Value *pSize = SearchInputByName(pFunction, strInputSize[i], pClonedBody->getTerminator());
+        if (pSize == NULL) {
+            errs() << "Cannot find the input size " << strInputSize[i] << "\n";
+            continue;
+        }
+        InlineHookInputSize(pSize, i, pClonedBody->getTerminator());
+    }
 
-    /*
-    * Append to condition1:
-    *  if (counter == 0) {
-    *    goto ifBody;
-    *  } else {
-    *    goto elseBody;
-    *  }
-    */
-    {
-        pLoad1 = new LoadInst(this->numGlobalCounter, "", false, pTerminator);
-        pLoad1->setAlignment(4);
-        pCmp = new ICmpInst(pTerminator, ICmpInst::ICMP_EQ, pLoad1, this->ConstantInt0, "cmp0");
-        pBranch = BranchInst::Create(pIfBody, pElseBody, pCmp);
-        ReplaceInstWithInst(pTerminator, pBranch);
+    // the automatic ones follow the named ones, the mapping is printed for the analysis
+    for (unsigned i = 0; i < vecAutoInputSize.size(); i++) {
+        unsigned uIndex = strInputSize.size() + i;
+        Value *pSize = MaterializeAtEntry(vecAutoInputSize[i], pInnerLoop, pClonedBody->getTerminator());
+        errs() << "Input size " << uIndex << ": " << *vecAutoInputSize[i] << "\n";
+        InlineHookInputSize(pSize, uIndex, pClonedBody->getTerminator());
     }
 
-    /*
-     * Append to ifBody:
-     *  counter = gen_random();
-     *  // instrumentDelimiter
-     *  goto clonedBody;
-     */
-    {
-        pLoad2 = new LoadInst(this->SAMPLE_RATE, "", false, 4, pIfBody);
-        pLoad2->setAlignment(4);
-        pCall = CallInst::Create(this->geo, pLoad2, "", pIfBody);
-        pCall->setCallingConv(CallingConv::C);
-        pCall->setTailCall(false);
-        pCall->setAttributes(emptySet);
-        pStore = new StoreInst(pCall, this->numGlobalCounter, false, 4, pIfBody);
-        pStore->setAlignment(4);
+    if (bCounterOnly) {
+        // the targets seen here make the profile of a later run with -indirectProfile
+        InstrumentIndirectTargets(vecCloned);
+
+        if (pTripCount) {
+            for (unsigned long i = 0; i < vecTripCount.size(); i++) {
+                vecTripCount[i]->moveBefore(pClonedBody->getTerminator());
+            }
+            InlineHookTripCount(pTripCount, pClonedBody->getTerminator());
+        } else {
+            InstrumentIterationCounter(pInnerLoop, VMap, pClonedBody->getTerminator(), vecExitCPI);
+        }
+    }
 
+    if (bCost) {
+        // counters only go on the chords, the cost is complete once the cloned loop exits
+        InstrumentCostUpdater(vecLoopCostEdges, pClonedBody->getTerminator());
 
-        BranchInst::Create(pClonedBody, pIfBody);
+        for (unsigned long i = 0; i < vecClonedCallee.size(); i++) {
+            InstrumentCostUpdater(mapCalleeCostEdges[vecClonedCallee[i]], NULL);
+        }
+
+        for (unsigned long i = 0; i < vecExitCPI.size(); i++) {
+            InlineHookCost(vecExitCPI[i]->getTerminator());
+        }
     }
 
-    /*
-     * Append to elseBody:
-     *  counter--;
-     *  goto header;
-     */
-    {
-        pLoad1 = new LoadInst(this->numGlobalCounter, "", false, pElseBody);
-        pLoad1->setAlignment(4);
-        pBinary = BinaryOperator::Create(Instruction::Add, pLoad1, this->ConstantIntN1, "dec1", pElseBody);
-        pStore = new StoreInst(pBinary, this->numGlobalCounter, false, pElseBody);
-        pStore->setAlignment(4);
-        BranchInst::Create(pHeader, pElseBody);
+    // promoted last, so that the cost counters are placed on the CFG they were computed for
+    if (!this->mapIndirectTargets.empty() && (!bCounterOnly || bCost)) {
+        PromoteIndirectCalls(vecCloned, VCalleeMap);
+
+        for (unsigned long i = 0; i < vecClonedCallee.size(); i++) {
+            vector<BasicBlock *> vecCalleeBlocks;
+            for (Function::iterator BB = vecClonedCallee[i]->begin(); BB != vecClonedCallee[i]->end(); BB++) {
+                vecCalleeBlocks.push_back(&*BB);
+            }
+            PromoteIndirectCalls(vecCalleeBlocks, VCalleeMap);
+        }
     }
+}
 
-    // condition1: num 0
-    vecAdded.push_back(pCondition1);
-    vecAdded.push_back(pIfBody);
-    // cloneBody: num 2
-    vecAdded.push_back(pClonedBody);
-    vecAdded.push_back(pElseBody);
+static void CollectFunctionBlocks(Function *F, vector<BasicBlock *> &vecBlocks) {
+
+    for (Function::iterator BB = F->begin(); BB != F->end(); BB++) {
+        vecBlocks.push_back(&*BB);
+    }
 }
 
-void LoopInstrumentor::CreateIfElseIfBlock(Loop *pInnerLoop, std::vector<BasicBlock *> &vecAdded) {
-    /*
-     * if (counter == 0) {              // condition1
-     *      counter--;                  // ifBody
-     *       // while                   //      cloneBody (to be instrumented)
-     * } else if (counter == -1) {      // condition2
-     *      counter = gen_random();     // elseIfBody
-     *      // while                    //      cloneBody (to be instrumented)
-     * } else {
-     *      counter--;                  // elseBody
-     *      // while                    //      header (original code, no instrumented)
-     * }
-     */
+/*
+ * The recursion is sampled like a loop: the root and the functions of its SCC get instrumented .CPI twins
+ * calling each other, and the calls entering the recursion from outside dispatch between twin and raw.
+ * One sampled top-level invocation is one delimited invocation in the trace.
+ */
+void LoopInstrumentor::InstrumentRecursiveFunction(Function *pRoot) {
 
-    BasicBlock *pCondition1 = NULL;
-    BasicBlock *pCondition2 = NULL;
+    set<Function *> setGroup;
+    SearchRecursiveGroup(pRoot, setGroup);
 
-    BasicBlock *pIfBody = NULL;
-    BasicBlock *pElseIfBody = NULL;
-    BasicBlock *pElseBody = NULL;
-    BasicBlock *pClonedBody = NULL;
+    if (setGroup.find(pRoot) == setGroup.end()) {
+        errs() << pRoot->getName() << " is not recursive\n";
+        return;
+    }
 
-    LoadInst *pLoad1 = NULL;
-    LoadInst *pLoad2 = NULL;
-    //   LoadInst *pLoad3 = NULL;
-    ICmpInst *pCmp = NULL;
+    ValueToValueMapTy VCalleeMap;
+    map<Function *, set<Instruction *> > FuncCallSiteMapping;
+    set<Function *> setSummarizedCallee;
 
-    BinaryOperator *pBinary = NULL;
-    TerminatorInst *pTerminator = NULL;
-    BranchInst *pBranch = NULL;
-    StoreInst *pStore = NULL;
-    CallInst *pCall = NULL;
-    AttributeList emptySet;
+    // the other functions of the SCC are reached as callees of the root
+    Function *pTwin = CloneFunction(pRoot, VCalleeMap, NULL);
+    pTwin->setName(pRoot->getName() + ".CPI");
+    pTwin->setLinkage(GlobalValue::InternalLinkage);
+    VCalleeMap[pRoot] = pTwin;
 
-    Function *pInnerFunction = pInnerLoop->getHeader()->getParent();
-    Module *pModule = pInnerFunction->getParent();
+    set<BasicBlock *> setRootBlocks;
+    for (Function::iterator BB = pRoot->begin(); BB != pRoot->end(); BB++) {
+        setRootBlocks.insert(&*BB);
+    }
 
-    pCondition1 = pInnerLoop->getLoopPreheader();
-    BasicBlock *pHeader = pInnerLoop->getHeader();
+    CloneFunctionCalled(setRootBlocks, VCalleeMap, FuncCallSiteMapping, setSummarizedCallee);
 
-    pIfBody = BasicBlock::Create(pModule->getContext(), ".if.body.CPI", pInnerFunction, 0);
+    // the twin first, then the cloned callees, all redirected to the twins
+    vector<Function *> vecClonedFunc;
+    vecClonedFunc.push_back(pTwin);
 
-    pCondition2 = BasicBlock::Create(pModule->getContext(), ".if2.CPI", pInnerFunction, 0);
+    map<Function *, vector<stCostEdge> > mapCostEdges;
+    if (bCost) {
+        CollectCalleeCostEdges(pRoot, VCalleeMap, mapCostEdges[pTwin]);
+    }
 
-    pElseIfBody = BasicBlock::Create(pModule->getContext(), ".else.if.body.CPI", pInnerFunction, 0);
-    // Contains original code, thus no CPI
-    pElseBody = BasicBlock::Create(pModule->getContext(), ".else.body", pInnerFunction, 0);
-    // Cloned code, added to ifBody and elseIfBody
-    pClonedBody = BasicBlock::Create(pModule->getContext(), ".cloned.body.CPI", pInnerFunction, 0);
+    for (map<Function *, set<Instruction *> >::iterator itMap = FuncCallSiteMapping.begin();
+         itMap != FuncCallSiteMapping.end(); itMap++) {
 
-    pTerminator = pCondition1->getTerminator();
+        ValueToValueMapTy::iterator FuncIt = VCalleeMap.find(itMap->first);
+        if (FuncIt == VCalleeMap.end() || FuncIt->second == pTwin) {
+            continue;
+        }
 
-    /*
-     * Append to condition1:
-     *  if (counter == 0) {
-     *    goto ifBody;
-     *  } else {
-     *    goto condition2;
-     *  }
-     */
-    {
-        pLoad1 = new LoadInst(this->numGlobalCounter, "", false, pTerminator);
-        pLoad1->setAlignment(4);
-        pCmp = new ICmpInst(pTerminator, ICmpInst::ICMP_EQ, pLoad1, this->ConstantInt0, "cmp0");
-        pBranch = BranchInst::Create(pIfBody, pCondition2, pCmp);
-        ReplaceInstWithInst(pTerminator, pBranch);
+        Function *pClonedCallee = cast<Function>(FuncIt->second);
+        vecClonedFunc.push_back(pClonedCallee);
+
+        if (bCost) {
+            CollectCalleeCostEdges(itMap->first, VCalleeMap, mapCostEdges[pClonedCallee]);
+        }
+    }
+
+    for (unsigned long i = 0; i < vecClonedFunc.size(); i++) {
+        vector<BasicBlock *> vecBlocks;
+        CollectFunctionBlocks(vecClonedFunc[i], vecBlocks);
+        RemapCalledFunction(vecBlocks, VCalleeMap);
+    }
+
+    if (bInputDependentOnly && !bCounterOnly) {
+        set<BasicBlock *> setTwinBlocks;
+        for (Function::iterator BB = pTwin->begin(); BB != pTwin->end(); BB++) {
+            setTwinBlocks.insert(&*BB);
+        }
+        vector<Function *> vecCallee(vecClonedFunc.begin() + 1, vecClonedFunc.end());
+        SearchInputDependentValues(setTwinBlocks, vecCallee, this->setInputDependent);
+    }
+
+    for (unsigned long i = 0; i < vecClonedFunc.size(); i++) {
+
+        vector<BasicBlock *> vecBlocks;
+        CollectFunctionBlocks(vecClonedFunc[i], vecBlocks);
+
+        if (!bCounterOnly) {
+            InstrumentAccesses(vecBlocks);
+        }
+
+        if (!setSummarizedCallee.empty()) {
+            InstrumentCalleeSummary(vecBlocks, setSummarizedCallee);
+        }
+
+        if (bCost) {
+            InstrumentCostUpdater(mapCostEdges[vecClonedFunc[i]], NULL);
+        }
+
+        if (!this->mapIndirectTargets.empty()) {
+            PromoteIndirectCalls(vecBlocks, VCalleeMap);
+        }
+    }
+
+    // in counter-only mode, the number of calls to the twin stands for the trip count
+    if (bCounterOnly) {
+        Instruction *pInsertBefore = &*pTwin->getEntryBlock().getFirstInsertionPt();
+        LoadInst *pLoad = new LoadInst(this->numGlobalIteration, "", false, pInsertBefore);
+        pLoad->setAlignment(8);
+        BinaryOperator *pAdd = BinaryOperator::Create(Instruction::Add, pLoad, this->ConstantLong1, "iteration.inc",
+                                                      pInsertBefore);
+        StoreInst *pStore = new StoreInst(pAdd, this->numGlobalIteration, false, pInsertBefore);
+        pStore->setAlignment(8);
+    }
+
+    // calls entering the recursion from outside, the recursive calls inside the SCC are left raw
+    vector<CallInst *> vecEntries;
+    unsigned long uInvokeEntries = 0;
+
+    for (Module::iterator FI = this->pModule->begin(); FI != this->pModule->end(); FI++) {
+
+        Function *pCaller = &*FI;
+        if (pCaller->isDeclaration() || setGroup.find(pCaller) != setGroup.end() ||
+            pCaller->getName().endswith(".CPI")) {
+            continue;
+        }
+
+        for (Function::iterator BB = pCaller->begin(); BB != pCaller->end(); BB++) {
+            for (BasicBlock::iterator II = BB->begin(); II != BB->end(); II++) {
+                CallInst *pCall = dyn_cast<CallInst>(II);
+                if (pCall && pCall->getCalledFunction() == pRoot) {
+                    vecEntries.push_back(pCall);
+                }
+
+                InvokeInst *pInvoke = dyn_cast<InvokeInst>(II);
+                if (pInvoke && pInvoke->getCalledFunction() == pRoot) {
+                    uInvokeEntries++;
+                }
+            }
+        }
+    }
+
+    // the hooks after the sampled call would need the normal and the unwind edge of an invoke
+    if (uInvokeEntries != 0) {
+        errs() << uInvokeEntries << " invoke(s) of " << pRoot->getName() << " are not sampled\n";
+    }
+
+    // func_id starts at 1, so each root gets its own id below -1 and a trace can mix several recursions
+    int iFuncID = GetFunctionID(pRoot);
+    long lRecursionID = iFuncID >= 0 ? -1 - (long) iFuncID : -1;
+    errs() << "Recursion " << lRecursionID << ": " << pRoot->getName() << "\n";
+
+    for (unsigned long i = 0; i < vecEntries.size(); i++) {
+
+        CallInst *pSampled = DispatchCallSite(vecEntries[i], pTwin);
+        Instruction *pAfter = pSampled->getNextNode();
+
+        InlineHookDelimit(pSampled, lRecursionID);
+        InlineSetSampling(this->ConstantInt0, pAfter);
+
+        // input sizes are named after the parameters of the root
+        for (unsigned j = 0; j < strInputSize.size(); j++) {
+            unsigned uArg = 0;
+            for (Function::arg_iterator AI = pRoot->arg_begin(); AI != pRoot->arg_end(); AI++, uArg++) {
+                if (AI->getName() == strInputSize[j]) {
+                    InlineHookInputSize(pSampled->getArgOperand(uArg), j, pSampled);
+                }
+            }
+        }
+
+        if (bCounterOnly) {
+            StoreInst *pStore = new StoreInst(this->ConstantLong0, this->numGlobalIteration, false, pSampled);
+            pStore->setAlignment(8);
+            LoadInst *pLoad = new LoadInst(this->numGlobalIteration, "", false, pAfter);
+            pLoad->setAlignment(8);
+            InlineHookTripCount(pLoad, pAfter);
+        }
+
+        if (bCost) {
+            StoreInst *pStore = new StoreInst(this->ConstantLong0, this->numGlobalCost, false, pSampled);
+            pStore->setAlignment(8);
+            InlineHookCost(pAfter);
+        }
+    }
+}
+
+/*
+ * if (counter == 0) {              // condition
+ *      counter = gen_random();     // ifBody
+ *      twin(args);                 //      instrumented
+ * } else {
+ *      counter--;                  // elseBody
+ *      raw(args);                  //      original call
+ * }
+ * Returns the call to the twin.
+ */
+CallInst *LoopInstrumentor::DispatchCallSite(CallInst *pCall, Function *pTwin) {
+
+    BasicBlock *pCondition = pCall->getParent();
+    Function *pCaller = pCondition->getParent();
+
+    BasicBlock *pElseBody = pCondition->splitBasicBlock(pCall, ".else.body");
+    BasicBlock *pMerge = pElseBody->splitBasicBlock(pCall->getNextNode(), ".dispatch.merge");
+    BasicBlock *pIfBody = BasicBlock::Create(this->pModule->getContext(), ".if.body.CPI", pCaller, pElseBody);
+
+    {
+        TerminatorInst *pTerminator = pCondition->getTerminator();
+        LoadInst *pLoad = new LoadInst(this->numGlobalCounter, "", false, pTerminator);
+        pLoad->setAlignment(4);
+        ICmpInst *pCmp = new ICmpInst(pTerminator, ICmpInst::ICMP_EQ, pLoad, this->ConstantInt0, "cmp0");
+        ReplaceInstWithInst(pTerminator, BranchInst::Create(pIfBody, pElseBody, pCmp));
+    }
+
+    InlineResetCounter(pIfBody);
+
+    CallInst *pSampled = cast<CallInst>(pCall->clone());
+    pSampled->setCalledFunction(pTwin);
+    pIfBody->getInstList().push_back(pSampled);
+    BranchInst::Create(pMerge, pIfBody);
+
+    InlineDecrementCounter(pCall);
+
+    if (!pCall->getType()->isVoidTy()) {
+        PHINode *pResult = PHINode::Create(pCall->getType(), 2, "dispatch.result", &*pMerge->begin());
+        pCall->replaceAllUsesWith(pResult);
+        pResult->addIncoming(pCall, pElseBody);
+        pResult->addIncoming(pSampled, pIfBody);
+    }
+
+    return pSampled;
+}
+
+/*
+ * .dispatch.entry:
+ * if (counter == 0) {              // condition
+ *      counter = gen_random();     // ifBody
+ *      return twin(args);          //      instrumented
+ * } else {
+ *      counter--;                  // elseBody
+ *      goto entry;                 //      original code
+ * }
+ * The fixed-size allocas of the old entry move up to the new one, so that they stay static.
+ * Variable arguments cannot be forwarded to the twin, the caller skips varargs functions.
+ */
+CallInst *LoopInstrumentor::DispatchFunctionEntry(Function *pFunction, Function *pTwin) {
+
+    BasicBlock *pOldEntry = &pFunction->getEntryBlock();
+    LLVMContext &Context = this->pModule->getContext();
+
+    BasicBlock *pCondition = BasicBlock::Create(Context, ".dispatch.entry", pFunction, pOldEntry);
+    BasicBlock *pIfBody = BasicBlock::Create(Context, ".if.body.CPI", pFunction, pOldEntry);
+    BasicBlock *pElseBody = BasicBlock::Create(Context, ".else.body", pFunction, pOldEntry);
+
+    LoadInst *pLoad = new LoadInst(this->numGlobalCounter, "", false, pCondition);
+    pLoad->setAlignment(4);
+    ICmpInst *pCmp = new ICmpInst(*pCondition, ICmpInst::ICMP_EQ, pLoad, this->ConstantInt0, "cmp0");
+    BranchInst::Create(pIfBody, pElseBody, pCmp, pCondition);
+
+    vector<AllocaInst *> vecAllocas;
+    for (BasicBlock::iterator II = pOldEntry->begin(); II != pOldEntry->end(); II++) {
+        AllocaInst *pAlloca = dyn_cast<AllocaInst>(II);
+        if (pAlloca != NULL && isa<Constant>(pAlloca->getArraySize())) {
+            vecAllocas.push_back(pAlloca);
+        }
+    }
+    for (unsigned long i = 0; i < vecAllocas.size(); i++) {
+        vecAllocas[i]->moveBefore(pLoad);
+    }
+
+    InlineResetCounter(pIfBody);
+
+    vector<Value *> vecArgs;
+    for (Function::arg_iterator AI = pFunction->arg_begin(); AI != pFunction->arg_end(); AI++) {
+        vecArgs.push_back(&*AI);
+    }
+
+    CallInst *pSampled = CallInst::Create(pTwin, vecArgs, "", pIfBody);
+    pSampled->setCallingConv(pFunction->getCallingConv());
+
+    if (pFunction->getReturnType()->isVoidTy()) {
+        ReturnInst::Create(Context, pIfBody);
+    } else {
+        ReturnInst::Create(Context, pSampled, pIfBody);
+    }
+
+    BranchInst *pBranch = BranchInst::Create(pOldEntry, pElseBody);
+    InlineDecrementCounter(pBranch);
+
+    return pSampled;
+}
+
+// counter = gen_random(), appended to pBlock
+void LoopInstrumentor::InlineResetCounter(BasicBlock *pBlock) {
+
+    AttributeList emptySet;
+
+    LoadInst *pLoad = new LoadInst(this->SAMPLE_RATE, "", false, 4, pBlock);
+    pLoad->setAlignment(4);
+    CallInst *pCall = CallInst::Create(this->geo, pLoad, "", pBlock);
+    pCall->setCallingConv(CallingConv::C);
+    pCall->setTailCall(false);
+    pCall->setAttributes(emptySet);
+    StoreInst *pStore = new StoreInst(pCall, this->numGlobalCounter, false, 4, pBlock);
+    pStore->setAlignment(4);
+}
+
+// counter--
+void LoopInstrumentor::InlineDecrementCounter(Instruction *InsertBefore) {
+
+    LoadInst *pLoad = new LoadInst(this->numGlobalCounter, "", false, InsertBefore);
+    pLoad->setAlignment(4);
+    BinaryOperator *pBinary = BinaryOperator::Create(Instruction::Add, pLoad, this->ConstantIntN1, "dec1",
+                                                     InsertBefore);
+    StoreInst *pStore = new StoreInst(pBinary, this->numGlobalCounter, false, InsertBefore);
+    pStore->setAlignment(4);
+}
+
+/*
+ * For loops in small functions called many times: the whole function gets a .CPI twin, and the sampling check
+ * runs once per call, at the call sites, or at the entry when the function is also called indirectly.
+ * Every top-level loop of the twin is then instrumented and delimited as a sampled loop would be,
+ * and the raw function keeps its shape for the inliner.
+ */
+void LoopInstrumentor::InstrumentFunctionDispatch(Function *pFunction, LoopInfo *pLI) {
+
+    vector<Loop *> vecLoops(pLI->begin(), pLI->end());
+    if (vecLoops.empty()) {
+        errs() << pFunction->getName() << " has no loop\n";
+        return;
+    }
+
+    set<BasicBlock *> setLoopBlocks;
+    for (unsigned long i = 0; i < vecLoops.size(); i++) {
+        setLoopBlocks.insert(vecLoops[i]->block_begin(), vecLoops[i]->block_end());
+    }
+
+    map<pair<BasicBlock *, BasicBlock *>, uint64_t> mapEdgeFreq;
+    if (bCost) {
+        GetEdgeFrequencies(pFunction, pLI, mapEdgeFreq);
+    }
+
+    ValueToValueMapTy VCalleeMap;
+    map<Function *, set<Instruction *> > FuncCallSiteMapping;
+    set<Function *> setSummarizedCallee;
+
+    if (!bCounterOnly || bCost) {
+        CloneFunctionCalled(setLoopBlocks, VCalleeMap, FuncCallSiteMapping, setSummarizedCallee);
+    }
+
+    map<Function *, vector<stCostEdge> > mapCalleeCostEdges;
+    vector<Function *> vecClonedCallee;
+
+    for (map<Function *, set<Instruction *> >::iterator itMap = FuncCallSiteMapping.begin();
+         itMap != FuncCallSiteMapping.end(); itMap++) {
+
+        ValueToValueMapTy::iterator FuncIt = VCalleeMap.find(itMap->first);
+        if (FuncIt == VCalleeMap.end()) {
+            continue;
+        }
+
+        Function *pClonedCallee = cast<Function>(FuncIt->second);
+        vecClonedCallee.push_back(pClonedCallee);
+
+        if (bCost) {
+            CollectCalleeCostEdges(itMap->first, VCalleeMap, mapCalleeCostEdges[pClonedCallee]);
+        }
+    }
+
+    ValueToValueMapTy VMap;
+    Function *pTwin = CloneFunction(pFunction, VMap, NULL);
+    pTwin->setName(pFunction->getName() + ".CPI");
+    pTwin->setLinkage(GlobalValue::InternalLinkage);
+
+    // only the loops of the twin are instrumented, the code around them runs as is
+    vector<BasicBlock *> vecTwinLoopBlocks;
+    for (set<BasicBlock *>::iterator itBlock = setLoopBlocks.begin(); itBlock != setLoopBlocks.end(); itBlock++) {
+        vecTwinLoopBlocks.push_back(cast<BasicBlock>(VMap[*itBlock]));
+    }
+
+    RemapCalledFunction(vecTwinLoopBlocks, VCalleeMap);
+
+    vector<vector<BasicBlock *> > vecLoopExits(vecLoops.size());
+    vector<vector<stCostEdge> > vecLoopCostEdges(vecLoops.size());
+
+    for (unsigned long i = 0; i < vecLoops.size(); i++) {
+        SplitClonedLoopExits(vecLoops[i], VMap, vecLoopExits[i]);
+        if (bCost) {
+            CollectLoopCostEdges(vecLoops[i], VMap, mapEdgeFreq, vecLoopCostEdges[i]);
+        }
+    }
+
+    if (bInputDependentOnly && !bCounterOnly) {
+        set<BasicBlock *> setTwinLoopBlocks(vecTwinLoopBlocks.begin(), vecTwinLoopBlocks.end());
+        SearchInputDependentValues(setTwinLoopBlocks, vecClonedCallee, this->setInputDependent);
+    }
+
+    if (!bCounterOnly) {
+        InstrumentAccesses(vecTwinLoopBlocks);
+
+        for (unsigned long i = 0; i < vecClonedCallee.size(); i++) {
+            vector<BasicBlock *> vecCalleeBlocks;
+            CollectFunctionBlocks(vecClonedCallee[i], vecCalleeBlocks);
+            InstrumentAccesses(vecCalleeBlocks);
+        }
+    }
+
+    if (!setSummarizedCallee.empty()) {
+        InstrumentCalleeSummary(vecTwinLoopBlocks, setSummarizedCallee);
+
+        for (unsigned long i = 0; i < vecClonedCallee.size(); i++) {
+            vector<BasicBlock *> vecCalleeBlocks;
+            CollectFunctionBlocks(vecClonedCallee[i], vecCalleeBlocks);
+            InstrumentCalleeSummary(vecCalleeBlocks, setSummarizedCallee);
+        }
+    }
+
+    // each invocation of a loop in a sampled call is one delimited invocation in the trace
+    for (unsigned long i = 0; i < vecLoops.size(); i++) {
+
+        BasicBlock *pPreHeader = vecLoops[i]->getLoopPreheader();
+        if (pPreHeader == NULL) {
+            errs() << "Cannot find the preheader of a loop in " << pFunction->getName() << "\n";
+            continue;
+        }
+
+        Instruction *pEntry = cast<BasicBlock>(VMap[pPreHeader])->getTerminator();
+
+        InlineHookDelimit(pEntry, GetLoopID(vecLoops[i]));
+
+        for (unsigned long j = 0; j < vecLoopExits[i].size(); j++) {
+            InlineSetSampling(this->ConstantInt0, vecLoopExits[i][j]->getTerminator());
+        }
+
+        for (unsigned j = 0; j < strInputSize.size(); j++) {
+            Value *pSize = SearchInputByName(pTwin, strInputSize[j], pEntry);
+            if (pSize == NULL) {
+                errs() << "Cannot find the input size " << strInputSize[j] << "\n";
+                continue;
+            }
+            InlineHookInputSize(pSize, j, pEntry);
+        }
+
+        if (bNestedMarkers) {
+            InstrumentNestedMarkers(vecLoops[i], VMap);
+        }
+
+        if (bCounterOnly) {
+            InstrumentIterationCounter(vecLoops[i], VMap, pEntry, vecLoopExits[i]);
+        }
+
+        if (bCost) {
+            InstrumentCostUpdater(vecLoopCostEdges[i], pEntry);
+            for (unsigned long j = 0; j < vecLoopExits[i].size(); j++) {
+                InlineHookCost(vecLoopExits[i][j]->getTerminator());
+            }
+        }
+    }
+
+    if (bCost) {
+        for (unsigned long i = 0; i < vecClonedCallee.size(); i++) {
+            InstrumentCostUpdater(mapCalleeCostEdges[vecClonedCallee[i]], NULL);
+        }
+    }
+
+    if (!this->mapIndirectTargets.empty() && (!bCounterOnly || bCost)) {
+        PromoteIndirectCalls(vecTwinLoopBlocks, VCalleeMap);
+
+        for (unsigned long i = 0; i < vecClonedCallee.size(); i++) {
+            vector<BasicBlock *> vecCalleeBlocks;
+            CollectFunctionBlocks(vecClonedCallee[i], vecCalleeBlocks);
+            PromoteIndirectCalls(vecCalleeBlocks, VCalleeMap);
+        }
+    }
+
+    if (bCounterOnly) {
+        // the targets seen here make the profile of a later run with -indirectProfile
+        InstrumentIndirectTargets(vecTwinLoopBlocks);
+    }
+
+    // dispatch at the direct call sites, unless some calls cannot be rewritten
+    vector<CallInst *> vecCallSites;
+    bool bEntryDispatch = pFunction->hasAddressTaken();
+
+    for (Module::iterator FI = this->pModule->begin(); FI != this->pModule->end(); FI++) {
+
+        Function *pCaller = &*FI;
+        if (pCaller->isDeclaration() || pCaller->getName().endswith(".CPI")) {
+            continue;
+        }
+
+        for (Function::iterator BB = pCaller->begin(); BB != pCaller->end(); BB++) {
+            for (BasicBlock::iterator II = BB->begin(); II != BB->end(); II++) {
+                if (CallInst *pCall = dyn_cast<CallInst>(II)) {
+                    if (pCall->getCalledFunction() == pFunction) {
+                        vecCallSites.push_back(pCall);
+                    }
+                } else if (InvokeInst *pInvoke = dyn_cast<InvokeInst>(II)) {
+                    if (pInvoke->getCalledFunction() == pFunction) {
+                        bEntryDispatch = true;
+                    }
+                }
+            }
+        }
+    }
+
+    if (bEntryDispatch && pFunction->isVarArg()) {
+        errs() << pFunction->getName() << " takes variable arguments, only its direct calls are sampled\n";
+        bEntryDispatch = false;
+    }
+
+    if (bEntryDispatch || (vecCallSites.empty() && !pFunction->isVarArg())) {
+        DispatchFunctionEntry(pFunction, pTwin);
+    } else {
+        for (unsigned long i = 0; i < vecCallSites.size(); i++) {
+            DispatchCallSite(vecCallSites[i], pTwin);
+        }
+    }
+}
+
+void LoopInstrumentor::LoadIndirectProfile(const std::string &sPath) {
+
+    std::ifstream fProfile(sPath.c_str());
+    if (!fProfile.is_open()) {
+        errs() << "Cannot open the indirect call profile " << sPath << "\n";
+        return;
+    }
+
+    map<int, vector<pair<unsigned long, Function *> > > mapSiteTargets;
+    std::string sLine;
+
+    while (std::getline(fProfile, sLine)) {
+
+        std::istringstream ssLine(sLine);
+        int iSite;
+        std::string sTarget;
+        unsigned long uCount;
+
+        if (!(ssLine >> iSite >> sTarget >> uCount) || iSite < 0) {
+            continue;
+        }
+
+        Function *pTarget = this->pModule->getFunction(sTarget);
+        if (pTarget == NULL || pTarget->isDeclaration()) {
+            errs() << "Cannot find the indirect target " << sTarget << "\n";
+            continue;
+        }
+
+        mapSiteTargets[iSite].push_back(make_pair(uCount, pTarget));
+    }
+
+    for (map<int, vector<pair<unsigned long, Function *> > >::iterator itSite = mapSiteTargets.begin();
+         itSite != mapSiteTargets.end(); itSite++) {
+
+        vector<pair<unsigned long, Function *> > &vecTargets = itSite->second;
+        stable_sort(vecTargets.begin(), vecTargets.end(),
+                    [](const pair<unsigned long, Function *> &a, const pair<unsigned long, Function *> &b) {
+                        return a.first > b.first;
+                    });
+
+        for (unsigned long i = 0; i < vecTargets.size() && i < uMaxPromotedTargets; i++) {
+            this->mapIndirectTargets[itSite->first].push_back(vecTargets[i].second);
+        }
+    }
+}
+
+/*
+ * Targets are recorded relative to main, so that TraceAnalyzer -y can name them from the symbols of the binary
+ * wherever it was loaded; raw when the module has no main.
+ */
+void LoopInstrumentor::InstrumentIndirectTargets(vector<BasicBlock *> &vecBlocks) {
+
+    Function *pAnchor = this->pModule->getFunction("main");
+    if (pAnchor != NULL && pAnchor->isDeclaration()) {
+        pAnchor = NULL;
+    }
+
+    for (vector<BasicBlock *>::iterator BB = vecBlocks.begin(); BB != vecBlocks.end(); BB++) {
+        for (BasicBlock::iterator II = (*BB)->begin(); II != (*BB)->end(); II++) {
+
+            if (!isa<CallInst>(II) && !isa<InvokeInst>(II)) {
+                continue;
+            }
+
+            CallSite cs(&*II);
+            Value *pCalledValue = cs.getCalledValue();
+            if (isa<Function>(pCalledValue->stripPointerCasts()) || isa<InlineAsm>(pCalledValue)) {
+                continue;
+            }
+
+            int iSite = GetInstructionID(&*II);
+            if (iSite < 0) {
+                continue;
+            }
+
+            Value *pTarget = new PtrToIntInst(pCalledValue, this->LongType, "", &*II);
+            if (pAnchor != NULL) {
+                CastInst *pBase = new PtrToIntInst(pAnchor, this->LongType, "", &*II);
+                pTarget = BinaryOperator::Create(Instruction::Sub, pTarget, pBase, "", &*II);
+            }
+            ConstantInt *pSite = ConstantInt::get(this->IntType, iSite);
+
+            InlineSetRecord(pTarget, pSite, this->ConstantInt10, &*II);
+            InlineMemcpy(&*II);
+        }
+    }
+}
+
+void LoopInstrumentor::PromoteIndirectCalls(vector<BasicBlock *> &vecBlocks, ValueToValueMapTy &VCalleeMap) {
+
+    vector<CallInst *> vecSites;
+
+    for (vector<BasicBlock *>::iterator BB = vecBlocks.begin(); BB != vecBlocks.end(); BB++) {
+        for (BasicBlock::iterator II = (*BB)->begin(); II != (*BB)->end(); II++) {
+
+            // invokes are left indirect, their unwind edges would need to be duplicated as well
+            CallInst *pCall = dyn_cast<CallInst>(II);
+            if (pCall == NULL) {
+                continue;
+            }
+
+            Value *pCalledValue = pCall->getCalledValue();
+            if (isa<Function>(pCalledValue->stripPointerCasts()) || isa<InlineAsm>(pCalledValue)) {
+                continue;
+            }
+
+            if (this->mapIndirectTargets.find(GetInstructionID(pCall)) != this->mapIndirectTargets.end()) {
+                vecSites.push_back(pCall);
+            }
+        }
+    }
+
+    vector<BasicBlock *> vecAdded;
+
+    for (unsigned long i = 0; i < vecSites.size(); i++) {
+
+        vector<Function *> &vecProfiled = this->mapIndirectTargets[GetInstructionID(vecSites[i])];
+        vector<Function *> vecTargets;
+
+        for (unsigned long j = 0; j < vecProfiled.size(); j++) {
+            if (vecProfiled[j]->getType() == vecSites[i]->getCalledValue()->getType()) {
+                vecTargets.push_back(vecProfiled[j]);
+            }
+        }
+
+        if (!vecTargets.empty()) {
+            PromoteIndirectCall(vecSites[i], vecTargets, VCalleeMap, vecAdded);
+        }
+    }
+
+    vecBlocks.insert(vecBlocks.end(), vecAdded.begin(), vecAdded.end());
+}
+
+/*
+ * if (fp == @t1) t1.CPI(args); else if (fp == @t2) t2.CPI(args); else fp(args);
+ * The fallback keeps the raw indirect call, so targets missing from the profile run uninstrumented.
+ */
+void LoopInstrumentor::PromoteIndirectCall(CallInst *pCall, vector<Function *> &vecTargets,
+                                           ValueToValueMapTy &VCalleeMap, vector<BasicBlock *> &vecAdded) {
+
+    Value *pCalledValue = pCall->getCalledValue();
+    BasicBlock *pBlock = pCall->getParent();
+    Function *pFunction = pBlock->getParent();
+
+    BasicBlock *pFallback = pBlock->splitBasicBlock(pCall, ".icp.fallback.CPI");
+    BasicBlock *pMerge = pFallback->splitBasicBlock(pCall->getNextNode(), ".icp.merge.CPI");
+    vecAdded.push_back(pFallback);
+    vecAdded.push_back(pMerge);
+
+    PHINode *pResult = NULL;
+    if (!pCall->getType()->isVoidTy()) {
+        pResult = PHINode::Create(pCall->getType(), vecTargets.size() + 1, "icp.result", &*pMerge->begin());
+        pCall->replaceAllUsesWith(pResult);
+        pResult->addIncoming(pCall, pFallback);
+    }
+
+    // the branch left by the split is replaced by the chain of compares
+    pBlock->getTerminator()->eraseFromParent();
+    BasicBlock *pCompare = pBlock;
+
+    for (unsigned long i = 0; i < vecTargets.size(); i++) {
+
+        Value *pDirectCallee = vecTargets[i];
+        ValueToValueMapTy::iterator FuncIt = VCalleeMap.find(vecTargets[i]);
+        if (FuncIt != VCalleeMap.end()) {
+            pDirectCallee = FuncIt->second;
+        }
+
+        BasicBlock *pDirect = BasicBlock::Create(this->pModule->getContext(), ".icp.direct.CPI", pFunction, pFallback);
+        BasicBlock *pNext = pFallback;
+        if (i + 1 < vecTargets.size()) {
+            pNext = BasicBlock::Create(this->pModule->getContext(), ".icp.compare.CPI", pFunction, pFallback);
+            vecAdded.push_back(pNext);
+        }
+        vecAdded.push_back(pDirect);
+
+        ICmpInst *pCmp = new ICmpInst(*pCompare, ICmpInst::ICMP_EQ, pCalledValue, vecTargets[i], "icp.cmp");
+        BranchInst::Create(pDirect, pNext, pCmp, pCompare);
+
+        CallInst *pDirectCall = cast<CallInst>(pCall->clone());
+        pDirectCall->setCalledFunction(pDirectCallee);
+        pDirect->getInstList().push_back(pDirectCall);
+        BranchInst::Create(pMerge, pDirect);
+
+        if (pResult) {
+            pResult->addIncoming(pDirectCall, pDirect);
+        }
+
+        pCompare = pNext;
+    }
+}
+
+/*
+ * One record per iteration of every loop of the nest, at its cloned header:
+ * the loop ID in the address and the nesting level below the sampled loop (0 for itself) in the length.
+ */
+void LoopInstrumentor::InstrumentNestedMarkers(Loop *pLoop, ValueToValueMapTy &VMap) {
+
+    set<Loop *> setLoops = getSubLoopSet(pLoop);
+
+    for (set<Loop *>::iterator itLoop = setLoops.begin(); itLoop != setLoops.end(); itLoop++) {
+
+        Loop *pSubLoop = *itLoop;
+        ValueToValueMapTy::iterator itHeader = VMap.find(pSubLoop->getHeader());
+        if (itHeader == VMap.end()) {
+            continue;
+        }
+
+        BasicBlock *pClonedHeader = cast<BasicBlock>(itHeader->second);
+        Instruction *pInsertBefore = &*pClonedHeader->getFirstInsertionPt();
+
+        ConstantInt *pLoopID = ConstantInt::get(this->LongType, GetLoopID(pSubLoop), true);
+        ConstantInt *pLevel = ConstantInt::get(this->IntType, pSubLoop->getLoopDepth() - pLoop->getLoopDepth());
+
+        InlineFlushAccesses(pInsertBefore);
+        InlineSetRecord(pLoopID, pLevel, this->ConstantInt11, pInsertBefore);
+        InlineMemcpy(pInsertBefore);
+    }
+}
+
+void LoopInstrumentor::CreateIfElseBlock(Loop *pInnerLoop, std::vector<BasicBlock *> &vecAdded) {
+    /*
+     * If (counter == 0) {              // condition1
+     *      counter = gen_random();     // ifBody
+     *      // while                    //      cloneBody (to be instrumented)
+     * } else {
+     *      counter--;                  // elseBody
+     *      // while                    //      header (original code, no instrumented)
+     * }
+     */
+
+    BasicBlock *pCondition1 = NULL;
+
+    BasicBlock *pIfBody = NULL;
+    BasicBlock *pElseBody = NULL;
+    BasicBlock *pClonedBody = NULL;
+
+    LoadInst *pLoad1 = NULL;
+    LoadInst *pLoad2 = NULL;
+
+    ICmpInst *pCmp = NULL;
+
+    BinaryOperator *pBinary = NULL;
+    TerminatorInst *pTerminator = NULL;
+    BranchInst *pBranch = NULL;
+    StoreInst *pStore = NULL;
+    CallInst *pCall = NULL;
+    AttributeList emptySet;
+
+    Function *pInnerFunction = pInnerLoop->getHeader()->getParent();
+    Module *pModule = pInnerFunction->getParent();
+
+    pCondition1 = pInnerLoop->getLoopPreheader();
+    BasicBlock *pHeader = pInnerLoop->getHeader();
+
+    pIfBody = BasicBlock::Create(pModule->getContext(), ".if.body.CPI", pInnerFunction, 0);
+    // Contains original code, thus no CPI
+    pElseBody = BasicBlock::Create(pModule->getContext(), ".else.body", pInnerFunction, 0);
+    // Cloned code, added to ifBody and elseIfBody
+    pClonedBody = BasicBlock::Create(pModule->getContext(), ".cloned.body.CPI", pInnerFunction, 0);
+
+    pTerminator = pCondition1->getTerminator();
+
+    /*
+    * Append to condition1:
+    *  if (counter == 0) {
+    *    goto ifBody;
+    *  } else {
+    *    goto elseBody;
+    *  }
+    */
+    {
+        pLoad1 = new LoadInst(this->numGlobalCounter, "", false, pTerminator);
+        pLoad1->setAlignment(4);
+        pCmp = new ICmpInst(pTerminator, ICmpInst::ICMP_EQ, pLoad1, this->ConstantInt0, "cmp0");
+        pBranch = BranchInst::Create(pIfBody, pElseBody, pCmp);
+        ReplaceInstWithInst(pTerminator, pBranch);
+    }
+
+    /*
+     * Append to ifBody:
+     *  counter = gen_random();
+     *  // instrumentDelimiter
+     *  goto clonedBody;
+     */
+    {
+        pLoad2 = new LoadInst(this->SAMPLE_RATE, "", false, 4, pIfBody);
+        pLoad2->setAlignment(4);
+        pCall = CallInst::Create(this->geo, pLoad2, "", pIfBody);
+        pCall->setCallingConv(CallingConv::C);
+        pCall->setTailCall(false);
+        pCall->setAttributes(emptySet);
+        pStore = new StoreInst(pCall, this->numGlobalCounter, false, 4, pIfBody);
+        pStore->setAlignment(4);
+
+
+        BranchInst::Create(pClonedBody, pIfBody);
+    }
+
+    /*
+     * Append to elseBody:
+     *  counter--;
+     *  goto header;
+     */
+    {
+        pLoad1 = new LoadInst(this->numGlobalCounter, "", false, pElseBody);
+        pLoad1->setAlignment(4);
+        pBinary = BinaryOperator::Create(Instruction::Add, pLoad1, this->ConstantIntN1, "dec1", pElseBody);
+        pStore = new StoreInst(pBinary, this->numGlobalCounter, false, pElseBody);
+        pStore->setAlignment(4);
+        BranchInst::Create(pHeader, pElseBody);
+    }
+
+    // condition1: num 0
+    vecAdded.push_back(pCondition1);
+    vecAdded.push_back(pIfBody);
+    // cloneBody: num 2
+    vecAdded.push_back(pClonedBody);
+    vecAdded.push_back(pElseBody);
+}
+
+void LoopInstrumentor::CreateIfElseIfBlock(Loop *pInnerLoop, std::vector<BasicBlock *> &vecAdded) {
+    /*
+     * if (counter == 0) {              // condition1
+     *      counter--;                  // ifBody
+     *       // while                   //      cloneBody (to be instrumented)
+     * } else if (counter == -1) {      // condition2
+     *      counter = gen_random();     // elseIfBody
+     *      // while                    //      cloneBody (to be instrumented)
+     * } else {
+     *      counter--;                  // elseBody
+     *      // while                    //      header (original code, no instrumented)
+     * }
+     */
+
+    BasicBlock *pCondition1 = NULL;
+    BasicBlock *pCondition2 = NULL;
+
+    BasicBlock *pIfBody = NULL;
+    BasicBlock *pElseIfBody = NULL;
+    BasicBlock *pElseBody = NULL;
+    BasicBlock *pClonedBody = NULL;
+
+    LoadInst *pLoad1 = NULL;
+    LoadInst *pLoad2 = NULL;
+    //   LoadInst *pLoad3 = NULL;
+    ICmpInst *pCmp = NULL;
+
+    BinaryOperator *pBinary = NULL;
+    TerminatorInst *pTerminator = NULL;
+    BranchInst *pBranch = NULL;
+    StoreInst *pStore = NULL;
+    CallInst *pCall = NULL;
+    AttributeList emptySet;
+
+    Function *pInnerFunction = pInnerLoop->getHeader()->getParent();
+    Module *pModule = pInnerFunction->getParent();
+
+    pCondition1 = pInnerLoop->getLoopPreheader();
+    BasicBlock *pHeader = pInnerLoop->getHeader();
+
+    pIfBody = BasicBlock::Create(pModule->getContext(), ".if.body.CPI", pInnerFunction, 0);
+
+    pCondition2 = BasicBlock::Create(pModule->getContext(), ".if2.CPI", pInnerFunction, 0);
+
+    pElseIfBody = BasicBlock::Create(pModule->getContext(), ".else.if.body.CPI", pInnerFunction, 0);
+    // Contains original code, thus no CPI
+    pElseBody = BasicBlock::Create(pModule->getContext(), ".else.body", pInnerFunction, 0);
+    // Cloned code, added to ifBody and elseIfBody
+    pClonedBody = BasicBlock::Create(pModule->getContext(), ".cloned.body.CPI", pInnerFunction, 0);
+
+    pTerminator = pCondition1->getTerminator();
+
+    /*
+     * Append to condition1:
+     *  if (counter == 0) {
+     *    goto ifBody;
+     *  } else {
+     *    goto condition2;
+     *  }
+     */
+    {
+        pLoad1 = new LoadInst(this->numGlobalCounter, "", false, pTerminator);
+        pLoad1->setAlignment(4);
+        pCmp = new ICmpInst(pTerminator, ICmpInst::ICMP_EQ, pLoad1, this->ConstantInt0, "cmp0");
+        pBranch = BranchInst::Create(pIfBody, pCondition2, pCmp);
+        ReplaceInstWithInst(pTerminator, pBranch);
     }
 
     /*
@@ -739,9 +1846,9 @@ void LoopInstrumentor::CloneInnerLoop(Loop *pLoop, std::vector<BasicBlock *> &ve
 
         if (pCurrent->hasName()) {
             NewBB->setName(pCurrent->getName() + ".CPI");
-            // add to vecCloned
-            vecCloned.push_back(NewBB);
         }
+        // add to vecCloned, value names may be discarded by the front end
+        vecCloned.push_back(NewBB);
 
         if (pCurrent->hasAddressTaken()) {
             errs() << "hasAddressTaken branch\n";
@@ -862,6 +1969,10 @@ void LoopInstrumentor::InstrumentRecordMemHooks(std::vector<BasicBlock *> &vecCl
         for (BasicBlock::iterator II = pBB->begin(); II != pBB->end(); II++) {
             Instruction *pInst = &*II;
 
+            if (bInputDependentOnly && !IsInputDependentAccess(pInst, this->setInputDependent)) {
+                continue;
+            }
+
             switch (pInst->getOpcode()) {
                 case Instruction::Load: {
                     Value *firstOperand = pInst->getOperand(0);
@@ -872,7 +1983,11 @@ void LoopInstrumentor::InstrumentRecordMemHooks(std::vector<BasicBlock *> &vecCl
                     }
                     if (!isa<FunctionType>(firstOperandType)) {
                         if (LoadInst *pLoad = dyn_cast<LoadInst>(pInst)) {
-                            InlineHookLoad(pLoad, pInst);
+                            if (pLoad->isAtomic() || pLoad->isVolatile()) {
+                                InlineHookShared(pLoad->getPointerOperand(), this->ConstantInt15, pInst);
+                            } else {
+                                InlineHookLoad(pLoad, pInst);
+                            }
                         }
                     }
                     break;
@@ -886,11 +2001,23 @@ void LoopInstrumentor::InstrumentRecordMemHooks(std::vector<BasicBlock *> &vecCl
                     }
                     if (!isa<FunctionType>(secondOperandType)) {
                         if (StoreInst *pStore = dyn_cast<StoreInst>(pInst)) {
-                            InlineHookStore(pStore, pInst);
+                            if (pStore->isAtomic() || pStore->isVolatile()) {
+                                InlineHookShared(pStore->getPointerOperand(), this->ConstantInt16, pInst);
+                            } else {
+                                InlineHookStore(pStore, pInst);
+                            }
                         }
                     }
                     break;
                 }
+                case Instruction::AtomicRMW: {
+                    InlineHookShared(cast<AtomicRMWInst>(pInst)->getPointerOperand(), this->ConstantInt17, pInst);
+                    break;
+                }
+                case Instruction::AtomicCmpXchg: {
+                    InlineHookShared(cast<AtomicCmpXchgInst>(pInst)->getPointerOperand(), this->ConstantInt17, pInst);
+                    break;
+                }
 //                // TODO: memcpy, memmove
 //                case Instruction::MemoryOps: {
 //                    break;
@@ -902,11 +2029,327 @@ void LoopInstrumentor::InstrumentRecordMemHooks(std::vector<BasicBlock *> &vecCl
     }
 }
 
+/*
+ * The library calls are searched before the hooks go in: InlineMemcpy calls llvm.memcpy too, and a model
+ * of it would write over the record of the hook.
+ */
+void LoopInstrumentor::InstrumentAccesses(vector<BasicBlock *> &vecBlocks) {
+
+    vector<pair<CallInst *, vector<const stLibcAccess *> > > vecLibcSites;
+    SearchLibcSites(vecBlocks, vecLibcSites);
+
+    InstrumentRecordMemHooks(vecBlocks);
+    InstrumentLibcModels(vecLibcSites);
+}
+
+/*
+ * Library calls are declarations and cannot be cloned, the ranges they touch are recorded after the call
+ * from the arguments and the return value, as load and store records.
+ */
+void LoopInstrumentor::SearchLibcSites(vector<BasicBlock *> &vecBlocks,
+                                       vector<pair<CallInst *, vector<const stLibcAccess *> > > &vecSites) {
+
+    for (vector<BasicBlock *>::iterator BB = vecBlocks.begin(); BB != vecBlocks.end(); BB++) {
+        for (BasicBlock::iterator II = (*BB)->begin(); II != (*BB)->end(); II++) {
+
+            CallInst *pCall = dyn_cast<CallInst>(II);
+            if (pCall == NULL) {
+                continue;
+            }
+
+            Function *pCalled = pCall->getCalledFunction();
+            if (pCalled == NULL || !pCalled->isDeclaration()) {
+                continue;
+            }
+
+            vector<const stLibcAccess *> vecAccesses;
+            SearchLibcModel(pCalled->getName(), vecAccesses);
+
+            if (!vecAccesses.empty()) {
+                vecSites.push_back(make_pair(pCall, vecAccesses));
+            }
+        }
+    }
+}
+
+void LoopInstrumentor::InstrumentLibcModels(vector<pair<CallInst *, vector<const stLibcAccess *> > > &vecSites) {
+
+    for (unsigned long i = 0; i < vecSites.size(); i++) {
+        Instruction *InsertBefore = vecSites[i].first->getNextNode();
+        for (unsigned long j = 0; j < vecSites[i].second.size(); j++) {
+            InlineHookLibcAccess(vecSites[i].first, vecSites[i].second[j], InsertBefore);
+        }
+    }
+}
+
+Value *LoopInstrumentor::GetLongArgument(CallInst *pCall, unsigned uIndex, Instruction *InsertBefore) {
+
+    if (uIndex >= pCall->getNumArgOperands() || !pCall->getArgOperand(uIndex)->getType()->isIntegerTy()) {
+        return NULL;
+    }
+
+    return CastInst::CreateIntegerCast(pCall->getArgOperand(uIndex), this->LongType, false, "", InsertBefore);
+}
+
+Value *LoopInstrumentor::InlineStringSize(Value *pString, Instruction *InsertBefore) {
+
+    Value *pChar = pString;
+    if (pChar->getType() != this->CharStarType) {
+        pChar = new BitCastInst(pString, this->CharStarType, "", InsertBefore);
+    }
+
+    CallInst *pLength = CallInst::Create(this->function_strlen, pChar, "", InsertBefore);
+    pLength->setCallingConv(CallingConv::C);
+
+    return BinaryOperator::Create(Instruction::Add, pLength, this->ConstantLong1, "", InsertBefore);
+}
+
+void LoopInstrumentor::InlineHookLibcAccess(CallInst *pCall, const stLibcAccess *pAccess, Instruction *InsertBefore) {
+
+    if (pAccess->uPointerArg >= pCall->getNumArgOperands()) {
+        return;
+    }
+
+    Value *pPointer = pCall->getArgOperand(pAccess->uPointerArg);
+    if (!pPointer->getType()->isPointerTy()) {
+        return;
+    }
+
+    if (bInputDependentOnly && this->setInputDependent.find(pPointer) == this->setInputDependent.end()) {
+        return;
+    }
+
+    Value *pReturn = NULL;
+    if (pCall->getType()->isIntegerTy()) {
+        pReturn = CastInst::CreateIntegerCast(pCall, this->LongType, true, "", InsertBefore);
+        // error returns (-1) touch nothing
+        ICmpInst *pPositive = new ICmpInst(InsertBefore, ICmpInst::ICMP_SGT, pReturn, this->ConstantLong0, "");
+        pReturn = SelectInst::Create(pPositive, pReturn, this->ConstantLong0, "", InsertBefore);
+    }
+
+    Value *pBytes = NULL;
+
+    switch (pAccess->eSize) {
+        case SIZE_CONSTANT: {
+            pBytes = ConstantInt::get(this->LongType, pAccess->uSize0);
+            break;
+        }
+        case SIZE_ARGUMENT: {
+            pBytes = GetLongArgument(pCall, pAccess->uSize0, InsertBefore);
+            break;
+        }
+        case SIZE_ARGUMENT_PRODUCT: {
+            Value *pSize0 = GetLongArgument(pCall, pAccess->uSize0, InsertBefore);
+            Value *pSize1 = GetLongArgument(pCall, pAccess->uSize1, InsertBefore);
+            if (pSize0 && pSize1) {
+                pBytes = BinaryOperator::Create(Instruction::Mul, pSize0, pSize1, "", InsertBefore);
+            }
+            break;
+        }
+        case SIZE_RETURN: {
+            pBytes = pReturn;
+            break;
+        }
+        case SIZE_RETURN_PRODUCT: {
+            Value *pSize0 = GetLongArgument(pCall, pAccess->uSize0, InsertBefore);
+            if (pReturn && pSize0) {
+                pBytes = BinaryOperator::Create(Instruction::Mul, pReturn, pSize0, "", InsertBefore);
+            }
+            break;
+        }
+        case SIZE_STRING: {
+            // strlen already returned it
+            if (pReturn && pCall->getCalledFunction()->getName() == "strlen") {
+                pBytes = BinaryOperator::Create(Instruction::Add, pReturn, this->ConstantLong1, "", InsertBefore);
+            } else {
+                pBytes = InlineStringSize(pPointer, InsertBefore);
+            }
+            break;
+        }
+        case SIZE_RETURN_OFFSET:
+        case SIZE_RETURN_OFFSET_ARGUMENT: {
+            if (!pCall->getType()->isPointerTy()) {
+                break;
+            }
+
+            Value *pNotFound = NULL;
+            if (pAccess->eSize == SIZE_RETURN_OFFSET) {
+                pNotFound = InlineStringSize(pPointer, InsertBefore);
+            } else {
+                pNotFound = GetLongArgument(pCall, pAccess->uSize0, InsertBefore);
+            }
+            if (pNotFound == NULL) {
+                break;
+            }
+
+            CastInst *pFound = new PtrToIntInst(pCall, this->LongType, "", InsertBefore);
+            CastInst *pStart = new PtrToIntInst(pPointer, this->LongType, "", InsertBefore);
+            BinaryOperator *pOffset = BinaryOperator::Create(Instruction::Sub, pFound, pStart, "", InsertBefore);
+            BinaryOperator *pFoundSize = BinaryOperator::Create(Instruction::Add, pOffset, this->ConstantLong1, "",
+                                                                InsertBefore);
+
+            ICmpInst *pIsNull = new ICmpInst(InsertBefore, ICmpInst::ICMP_EQ, pFound, this->ConstantLong0, "");
+            pBytes = SelectInst::Create(pIsNull, pNotFound, pFoundSize, "", InsertBefore);
+            break;
+        }
+    }
+
+    if (pBytes == NULL) {
+        return;
+    }
+
+    CastInst *pAddress = new PtrToIntInst(pPointer, this->LongType, "", InsertBefore);
+
+    // the lines the range spans, not filtered per site as a single line is
+    if (bCacheLine) {
+        ConstantInt *pLineMask = ConstantInt::getSigned(this->LongType, -64);
+        BinaryOperator *pEnd = BinaryOperator::Create(Instruction::Add, pAddress, pBytes, "", InsertBefore);
+        pEnd = BinaryOperator::Create(Instruction::Add, pEnd, ConstantInt::get(this->LongType, 63), "", InsertBefore);
+        pEnd = BinaryOperator::Create(Instruction::And, pEnd, pLineMask, "", InsertBefore);
+        BinaryOperator *pLine = BinaryOperator::Create(Instruction::And, pAddress, pLineMask, "", InsertBefore);
+        pBytes = BinaryOperator::Create(Instruction::Sub, pEnd, pLine, "", InsertBefore);
+        pAddress = pLine;
+    }
+
+    // lengths are in bits, as for loads and stores, clamped to what the 32-bit field holds
+    ConstantInt *pMaxBytes = ConstantInt::get(this->LongType, 0xFFFFFFFFUL >> 3);
+    ICmpInst *pOver = new ICmpInst(InsertBefore, ICmpInst::ICMP_UGT, pBytes, pMaxBytes, "");
+    pBytes = SelectInst::Create(pOver, pMaxBytes, pBytes, "", InsertBefore);
+    BinaryOperator *pBits = BinaryOperator::Create(Instruction::Shl, pBytes, ConstantInt::get(this->LongType, 3), "",
+                                                   InsertBefore);
+    CastInst *pLength = new TruncInst(pBits, this->IntType, "", InsertBefore);
+    ConstantInt *pFlag = pAccess->bWrite ? this->ConstantInt3 : this->ConstantInt2;
+
+    // the same paths as a load or a store
+    if (bCoalesce) {
+        InlineHookCoalesce(pAddress, pLength, pFlag, InsertBefore);
+    } else if (bDistinct) {
+        InlineHookDistinct(pAddress, pLength, pFlag, InsertBefore);
+    } else {
+        InlineSetRecord(pAddress, pLength, pFlag, InsertBefore);
+        InlineMemcpy(InsertBefore);
+    }
+}
+
+void LoopInstrumentor::InstrumentCalleeSummary(vector<BasicBlock *> &vecBlocks, set<Function *> &setSummarized) {
+
+    map<Function *, long> mapExpectedCost;
+
+    for (vector<BasicBlock *>::iterator BB = vecBlocks.begin(); BB != vecBlocks.end(); BB++) {
+        for (BasicBlock::iterator II = (*BB)->begin(); II != (*BB)->end(); II++) {
+
+            if (!isa<CallInst>(II) && !isa<InvokeInst>(II)) {
+                continue;
+            }
+
+            CallSite cs(&*II);
+            Function *pCalled = cs.getCalledFunction();
+            if (pCalled == NULL || setSummarized.find(pCalled) == setSummarized.end()) {
+                continue;
+            }
+
+            Instruction *pCall = &*II;
+
+            if (!bCounterOnly) {
+                for (unsigned i = 0; i < cs.arg_size(); i++) {
+                    if (cs.getArgument(i)->getType()->isPointerTy()) {
+                        InlineHookCalleeArgument(cs.getArgument(i), pCall);
+                    }
+                }
+            }
+
+            if (bCost) {
+                if (mapExpectedCost.find(pCalled) == mapExpectedCost.end()) {
+                    mapExpectedCost[pCalled] = GetExpectedFunctionCost(pCalled);
+                }
+                InlineIncrementCost(mapExpectedCost[pCalled], pCall);
+            }
+        }
+    }
+}
+
+void LoopInstrumentor::InlineHookCalleeArgument(Value *pArg, Instruction *InsertBefore) {
+
+    Type *pPointee = pArg->getType()->getContainedType(0);
+    if (isa<FunctionType>(pPointee)) {
+        return;
+    }
+
+    // the extent of the object is unknown, only the pointed type is: the analyzer does not count it as a read
+    const DataLayout &DL = this->pModule->getDataLayout();
+    uint64_t uLength = pPointee->isSized() ? DL.getTypeAllocSizeInBits(pPointee) : 0;
+
+    ConstantInt *pLength = ConstantInt::get(this->IntType, uLength);
+    CastInst *pAddress = new PtrToIntInst(pArg, this->LongType, "", InsertBefore);
+
+    InlineSetRecord(pAddress, pLength, this->ConstantInt9, InsertBefore);
+    InlineMemcpy(InsertBefore);
+}
+
+static unsigned long GetFunctionSize(Function *F) {
+
+    unsigned long uSize = 0;
+    for (Function::iterator BB = F->begin(); BB != F->end(); BB++) {
+        uSize += BB->size();
+    }
+
+    return uSize;
+}
+
+/*
+ * Callees are visited breadth-first from the loop, so that the clone limits keep the nearest ones.
+ * A callee beyond the depth or over the size budget is not cloned, nor searched, and lands in setSummarized.
+ */
 void LoopInstrumentor::CloneFunctionCalled(set<BasicBlock *> &setBlocksInLoop, ValueToValueMapTy &VCalleeMap,
-                                           map<Function *, set<Instruction *> > &FuncCallSiteMapping) {
-    vector<Function *> vecWorkList;
+                                           map<Function *, set<Instruction *> > &FuncCallSiteMapping,
+                                           set<Function *> &setSummarized) {
+    vector<pair<Function *, unsigned> > vecWorkList;
+    unsigned long uWorkIndex = 0;
+    unsigned long uClonedSize = 0;
     set<Function *> toDo;
 
+    auto AdmitCallee = [&](Function *pCalled, unsigned uDepth) -> bool {
+        if (toDo.find(pCalled) != toDo.end()) {
+            return true;
+        }
+
+        // already has a twin, e.g. the root of a recursion
+        if (VCalleeMap.find(pCalled) != VCalleeMap.end()) {
+            return false;
+        }
+
+        if (setSummarized.find(pCalled) != setSummarized.end()) {
+            return false;
+        }
+
+        unsigned long uSize = GetFunctionSize(pCalled);
+        if ((uMaxCloneDepth > 0 && uDepth > uMaxCloneDepth) ||
+            (uMaxCloneSize > 0 && uClonedSize + uSize > uMaxCloneSize)) {
+            setSummarized.insert(pCalled);
+            return false;
+        }
+
+        uClonedSize += uSize;
+        toDo.insert(pCalled);
+        vecWorkList.push_back(make_pair(pCalled, uDepth));
+        return true;
+    };
+
+    // the profiled targets of an indirect call are cloned as if they were called directly, but the call itself
+    // is left to PromoteIndirectCall, which guards it: no call site is mapped, only the callee is listed
+    auto AdmitIndirectTargets = [&](Instruction *pCall, unsigned uDepth) {
+        map<int, vector<Function *> >::iterator itTargets = this->mapIndirectTargets.find(GetInstructionID(pCall));
+        if (itTargets == this->mapIndirectTargets.end()) {
+            return;
+        }
+
+        for (unsigned long i = 0; i < itTargets->second.size(); i++) {
+            if (AdmitCallee(itTargets->second[i], uDepth)) {
+                FuncCallSiteMapping[itTargets->second[i]];
+            }
+        }
+    };
+
     set<Instruction *> setMonitoredInstInCallee;
 
     set<BasicBlock *>::iterator itBlockSetBegin = setBlocksInLoop.begin();
@@ -927,6 +2370,7 @@ void LoopInstrumentor::CloneFunctionCalled(set<BasicBlock *> &setBlocksInLoop, V
                 Function *pCalled = cs.getCalledFunction();
 
                 if (pCalled == NULL) {
+                    AdmitIndirectTargets(&*II, 1);
                     continue;
                 }
 
@@ -934,19 +2378,17 @@ void LoopInstrumentor::CloneFunctionCalled(set<BasicBlock *> &setBlocksInLoop, V
                     continue;
                 }
 
-                FuncCallSiteMapping[pCalled].insert(&*II);
-
-                if (toDo.find(pCalled) == toDo.end()) {
-                    toDo.insert(pCalled);
-                    vecWorkList.push_back(pCalled);
+                if (AdmitCallee(pCalled, 1)) {
+                    FuncCallSiteMapping[pCalled].insert(&*II);
                 }
             }
         }
     }
 
-    while (vecWorkList.size() > 0) {
-        Function *pCurrent = vecWorkList[vecWorkList.size() - 1];
-        vecWorkList.pop_back();
+    while (uWorkIndex < vecWorkList.size()) {
+        Function *pCurrent = vecWorkList[uWorkIndex].first;
+        unsigned uDepth = vecWorkList[uWorkIndex].second;
+        uWorkIndex++;
 
         for (Function::iterator BB = pCurrent->begin(); BB != pCurrent->end(); BB++) {
             if (isa<UnreachableInst>(BB->getTerminator())) {
@@ -960,13 +2402,10 @@ void LoopInstrumentor::CloneFunctionCalled(set<BasicBlock *> &setBlocksInLoop, V
                     CallSite cs(&*II);
                     Function *pCalled = cs.getCalledFunction();
 
-                    if (pCalled != NULL && !pCalled->isDeclaration()) {
+                    if (pCalled == NULL) {
+                        AdmitIndirectTargets(&*II, uDepth + 1);
+                    } else if (!pCalled->isDeclaration() && AdmitCallee(pCalled, uDepth + 1)) {
                         FuncCallSiteMapping[pCalled].insert(&*II);
-
-                        if (toDo.find(pCalled) == toDo.end()) {
-                            toDo.insert(pCalled);
-                            vecWorkList.push_back(pCalled);
-                        }
                     }
                 }
 
@@ -1032,6 +2471,385 @@ void LoopInstrumentor::CloneFunctionCalled(set<BasicBlock *> &setBlocksInLoop, V
     }
 }
 
+void LoopInstrumentor::RemapCalledFunction(vector<BasicBlock *> &vecCloned, ValueToValueMapTy &VCalleeMap) {
+
+    for (vector<BasicBlock *>::iterator BB = vecCloned.begin(); BB != vecCloned.end(); BB++) {
+        for (BasicBlock::iterator II = (*BB)->begin(); II != (*BB)->end(); II++) {
+
+            if (!isa<CallInst>(II) && !isa<InvokeInst>(II)) {
+                continue;
+            }
+
+            CallSite cs(&*II);
+            Function *pCalled = cs.getCalledFunction();
+            if (pCalled == NULL) {
+                continue;
+            }
+
+            ValueToValueMapTy::iterator FuncIt = VCalleeMap.find(pCalled);
+            if (FuncIt != VCalleeMap.end()) {
+                cs.setCalledFunction(FuncIt->second);
+            }
+        }
+    }
+}
+
+BasicBlock *LoopInstrumentor::SplitEdgeCPI(BasicBlock *pFrom, BasicBlock *pTo, const std::string &sName) {
+
+    BasicBlock *pNew = BasicBlock::Create(pFrom->getContext(), sName, pFrom->getParent(), pTo);
+    BranchInst::Create(pTo, pNew);
+
+    // identical edges (e.g. switch cases) are merged into the new block
+    TerminatorInst *pTerminator = pFrom->getTerminator();
+    for (unsigned i = 0; i < pTerminator->getNumSuccessors(); i++) {
+        if (pTerminator->getSuccessor(i) == pTo) {
+            pTerminator->setSuccessor(i, pNew);
+        }
+    }
+
+    for (BasicBlock::iterator II = pTo->begin(); II != pTo->end(); II++) {
+        PHINode *pPHI = dyn_cast<PHINode>(II);
+        if (!pPHI) {
+            break;
+        }
+
+        vector<unsigned> vecDuplicated;
+        for (unsigned i = 0; i < pPHI->getNumIncomingValues(); i++) {
+            if (pPHI->getIncomingBlock(i) != pFrom) {
+                continue;
+            }
+            if (vecDuplicated.empty()) {
+                pPHI->setIncomingBlock(i, pNew);
+            }
+            vecDuplicated.push_back(i);
+        }
+
+        for (unsigned long i = vecDuplicated.size(); i > 1; i--) {
+            pPHI->removeIncomingValue(vecDuplicated[i - 1], false);
+        }
+    }
+
+    return pNew;
+}
+
+void LoopInstrumentor::SplitClonedLoopExits(Loop *pLoop, ValueToValueMapTy &VMap, vector<BasicBlock *> &vecExitCPI) {
+
+    for (Loop::block_iterator BB = pLoop->block_begin(); BB != pLoop->block_end(); BB++) {
+
+        BasicBlock *pClonedBlock = cast<BasicBlock>(VMap[*BB]);
+        TerminatorInst *pTerminator = (*BB)->getTerminator();
+
+        set<BasicBlock *> setExit;
+        for (unsigned i = 0; i < pTerminator->getNumSuccessors(); i++) {
+            if (!pLoop->contains(pTerminator->getSuccessor(i))) {
+                setExit.insert(pTerminator->getSuccessor(i));
+            }
+        }
+
+        for (set<BasicBlock *>::iterator itExit = setExit.begin(); itExit != setExit.end(); itExit++) {
+            // unwind edges cannot be split, leaving by an exception is not a sampled invocation
+            if ((*itExit)->isLandingPad()) {
+                continue;
+            }
+            // the exits are mapped to themselves for a cloned loop, to their copy in a cloned function
+            BasicBlock *pClonedExit = cast<BasicBlock>(VMap[*itExit]);
+            vecExitCPI.push_back(SplitEdgeCPI(pClonedBlock, pClonedExit, ".loop.exit.CPI"));
+        }
+    }
+}
+
+void LoopInstrumentor::CollectLoopCostEdges(Loop *pLoop, ValueToValueMapTy &VMap,
+                                            map<pair<BasicBlock *, BasicBlock *>, uint64_t> &mapEdgeFreq,
+                                            vector<stCostEdge> &vecEdges) {
+
+    map<BasicBlock *, int> mapBlockCost;
+
+    stCostEdge Edge;
+    Edge.bChord = true;
+    Edge.lIncrement = 0;
+
+    // the virtual edge, taken once per sampled invocation
+    Edge.pSrc = NULL;
+    Edge.pDst = cast<BasicBlock>(VMap[pLoop->getHeader()]);
+    Edge.uFreq = 0;
+    vecEdges.push_back(Edge);
+
+    for (Loop::block_iterator BB = pLoop->block_begin(); BB != pLoop->block_end(); BB++) {
+
+        BasicBlock *pClonedBlock = cast<BasicBlock>(VMap[*BB]);
+        // the clone is a copy, the cost of the original block is not polluted by hooks
+        mapBlockCost[pClonedBlock] = GetBlockCost(*BB);
+
+        TerminatorInst *pTerminator = (*BB)->getTerminator();
+        set<BasicBlock *> setSucc;
+        for (unsigned i = 0; i < pTerminator->getNumSuccessors(); i++) {
+            setSucc.insert(pTerminator->getSuccessor(i));
+        }
+
+        for (set<BasicBlock *>::iterator itSucc = setSucc.begin(); itSucc != setSucc.end(); itSucc++) {
+
+            Edge.pSrc = pClonedBlock;
+            Edge.uFreq = mapEdgeFreq[make_pair(*BB, *itSucc)];
+
+            if (pLoop->contains(*itSucc)) {
+                Edge.pDst = cast<BasicBlock>(VMap[*itSucc]);
+                vecEdges.push_back(Edge);
+                continue;
+            }
+
+            // the exit edge goes through the block put there by SplitClonedLoopExits
+            BasicBlock *pExitCPI = NULL;
+            BasicBlock *pClonedExit = cast<BasicBlock>(VMap[*itSucc]);
+            TerminatorInst *pClonedTerminator = pClonedBlock->getTerminator();
+            for (unsigned i = 0; i < pClonedTerminator->getNumSuccessors(); i++) {
+                if (pClonedTerminator->getSuccessor(i)->getSingleSuccessor() == pClonedExit) {
+                    pExitCPI = pClonedTerminator->getSuccessor(i);
+                }
+            }
+
+            if (pExitCPI == NULL) {
+                continue;
+            }
+
+            mapBlockCost[pExitCPI] = 0;
+
+            Edge.pDst = pExitCPI;
+            vecEdges.push_back(Edge);
+
+            Edge.pSrc = pExitCPI;
+            Edge.pDst = NULL;
+            vecEdges.push_back(Edge);
+        }
+    }
+
+    BuildMaxSpanningTree(vecEdges);
+    ComputeChordIncrements(vecEdges, mapBlockCost);
+}
+
+void LoopInstrumentor::CollectCalleeCostEdges(Function *pRawFunction, ValueToValueMapTy &VCalleeMap,
+                                              vector<stCostEdge> &vecEdges) {
+
+    map<pair<BasicBlock *, BasicBlock *>, uint64_t> mapEdgeFreq;
+    GetEdgeFrequencies(pRawFunction, NULL, mapEdgeFreq);
+
+    map<BasicBlock *, int> mapBlockCost;
+
+    stCostEdge Edge;
+    Edge.bChord = true;
+    Edge.lIncrement = 0;
+
+    // the virtual edge, taken once per call
+    Edge.pSrc = NULL;
+    Edge.pDst = cast<BasicBlock>(VCalleeMap[&pRawFunction->getEntryBlock()]);
+    Edge.uFreq = 0;
+    vecEdges.push_back(Edge);
+
+    for (Function::iterator BB = pRawFunction->begin(); BB != pRawFunction->end(); BB++) {
+
+        BasicBlock *pRawBlock = &*BB;
+        BasicBlock *pClonedBlock = cast<BasicBlock>(VCalleeMap[pRawBlock]);
+        mapBlockCost[pClonedBlock] = GetBlockCost(pRawBlock);
+
+        TerminatorInst *pTerminator = pRawBlock->getTerminator();
+        Edge.pSrc = pClonedBlock;
+
+        if (pTerminator->getNumSuccessors() == 0) {
+            Edge.pDst = NULL;
+            Edge.uFreq = mapEdgeFreq[make_pair(pRawBlock, (BasicBlock *) NULL)];
+            vecEdges.push_back(Edge);
+            continue;
+        }
+
+        set<BasicBlock *> setSucc;
+        for (unsigned i = 0; i < pTerminator->getNumSuccessors(); i++) {
+            setSucc.insert(pTerminator->getSuccessor(i));
+        }
+
+        for (set<BasicBlock *>::iterator itSucc = setSucc.begin(); itSucc != setSucc.end(); itSucc++) {
+            Edge.pDst = cast<BasicBlock>(VCalleeMap[*itSucc]);
+            Edge.uFreq = mapEdgeFreq[make_pair(pRawBlock, *itSucc)];
+            vecEdges.push_back(Edge);
+        }
+    }
+
+    BuildMaxSpanningTree(vecEdges);
+    ComputeChordIncrements(vecEdges, mapBlockCost);
+}
+
+void LoopInstrumentor::InstrumentCostUpdater(vector<stCostEdge> &vecEdges, Instruction *pResetBefore) {
+
+    for (vector<stCostEdge>::iterator itEdge = vecEdges.begin(); itEdge != vecEdges.end(); itEdge++) {
+
+        if (!itEdge->bChord) {
+            continue;
+        }
+
+        // the virtual edge: numGlobalCost = increment at the loop entry, numGlobalCost += increment at the callee entry
+        if (itEdge->pSrc == NULL) {
+            if (pResetBefore) {
+                ConstantInt *pInit = ConstantInt::get(this->LongType, itEdge->lIncrement, true);
+                StoreInst *pStore = new StoreInst(pInit, this->numGlobalCost, false, pResetBefore);
+                pStore->setAlignment(8);
+            } else if (itEdge->lIncrement != 0) {
+                InlineIncrementCost(itEdge->lIncrement, &*itEdge->pDst->getFirstInsertionPt());
+            }
+            continue;
+        }
+
+        if (itEdge->lIncrement == 0) {
+            continue;
+        }
+
+        Instruction *pInsertBefore = NULL;
+
+        if (itEdge->pDst == NULL || itEdge->pSrc->getTerminator()->getNumSuccessors() == 1) {
+            pInsertBefore = itEdge->pSrc->getTerminator();
+        } else if (itEdge->pDst->getSinglePredecessor() == itEdge->pSrc) {
+            pInsertBefore = &*itEdge->pDst->getFirstInsertionPt();
+        } else {
+            // BuildMaxSpanningTree keeps every unwind edge in the tree
+            assert(!itEdge->pDst->isEHPad());
+            pInsertBefore = SplitEdgeCPI(itEdge->pSrc, itEdge->pDst, ".cost.edge.CPI")->getTerminator();
+        }
+
+        InlineIncrementCost(itEdge->lIncrement, pInsertBefore);
+    }
+}
+
+void LoopInstrumentor::InlineIncrementCost(long lIncrement, Instruction *InsertBefore) {
+
+    // numGlobalCost += lIncrement
+    LoadInst *pLoad = new LoadInst(this->numGlobalCost, "", false, InsertBefore);
+    pLoad->setAlignment(8);
+    ConstantInt *pIncrement = ConstantInt::get(this->LongType, lIncrement, true);
+    BinaryOperator *pAdd = BinaryOperator::Create(Instruction::Add, pLoad, pIncrement, "cost.inc", InsertBefore);
+    StoreInst *pStore = new StoreInst(pAdd, this->numGlobalCost, false, InsertBefore);
+    pStore->setAlignment(8);
+}
+
+void LoopInstrumentor::InlineHookCost(Instruction *InsertBefore) {
+
+    LoadInst *pLoad = new LoadInst(this->numGlobalCost, "", false, InsertBefore);
+    pLoad->setAlignment(8);
+
+    InlineSetRecord(pLoad, this->ConstantInt0, this->ConstantInt6, InsertBefore);
+    InlineMemcpy(InsertBefore);
+}
+
+Value *LoopInstrumentor::ExpandTripCount(Loop *pLoop, ScalarEvolution &SE, vector<Instruction *> &vecExpanded) {
+
+    BasicBlock *pPreHeader = pLoop->getLoopPreheader();
+
+    if (pPreHeader == NULL) {
+        return NULL;
+    }
+
+    const SCEV *pBackedgeTaken = SE.getBackedgeTakenCount(pLoop);
+    if (isa<SCEVCouldNotCompute>(pBackedgeTaken)) {
+        return NULL;
+    }
+
+    // the header runs once more than the back edge
+    const SCEV *pTripCount = SE.getAddExpr(SE.getNoopOrZeroExtend(pBackedgeTaken, this->LongType),
+                                           SE.getOne(this->LongType));
+    if (!isSafeToExpand(pTripCount, SE)) {
+        return NULL;
+    }
+
+    Instruction *pTerminator = pPreHeader->getTerminator();
+    Instruction *pLast = pTerminator->getPrevNode();
+
+    SCEVExpander Expander(SE, this->pModule->getDataLayout(), "tripcount");
+    Value *pValue = Expander.expandCodeFor(pTripCount, this->LongType, pTerminator);
+
+    BasicBlock::iterator II = pLast ? ++BasicBlock::iterator(pLast) : pPreHeader->begin();
+    for (; &*II != pTerminator; II++) {
+        vecExpanded.push_back(&*II);
+    }
+
+    return pValue;
+}
+
+void LoopInstrumentor::InstrumentIterationCounter(Loop *pLoop, ValueToValueMapTy &VMap, Instruction *pResetBefore,
+                                                  vector<BasicBlock *> &vecExitCPI) {
+
+    // numGlobalIteration = 0
+    StoreInst *pStore = new StoreInst(this->ConstantLong0, this->numGlobalIteration, false, pResetBefore);
+    pStore->setAlignment(8);
+
+    // numGlobalIteration++ in the cloned header
+    BasicBlock *pClonedHeader = cast<BasicBlock>(VMap[pLoop->getHeader()]);
+    Instruction *pInsertBefore = &*pClonedHeader->getFirstInsertionPt();
+
+    LoadInst *pLoad = new LoadInst(this->numGlobalIteration, "", false, pInsertBefore);
+    pLoad->setAlignment(8);
+    BinaryOperator *pAdd = BinaryOperator::Create(Instruction::Add, pLoad, this->ConstantLong1, "iteration.inc",
+                                                  pInsertBefore);
+    pStore = new StoreInst(pAdd, this->numGlobalIteration, false, pInsertBefore);
+    pStore->setAlignment(8);
+
+    for (unsigned long i = 0; i < vecExitCPI.size(); i++) {
+        pLoad = new LoadInst(this->numGlobalIteration, "", false, vecExitCPI[i]->getTerminator());
+        pLoad->setAlignment(8);
+        InlineHookTripCount(pLoad, vecExitCPI[i]->getTerminator());
+    }
+}
+
+/*
+ * The current value of a source variable: reload it if it lives in memory (dbg.declare),
+ * otherwise take the argument of the same name.
+ */
+Value *LoopInstrumentor::SearchInputByName(Function *pFunction, const std::string &sName, Instruction *InsertBefore) {
+
+    for (Function::iterator BB = pFunction->begin(); BB != pFunction->end(); BB++) {
+        for (BasicBlock::iterator II = BB->begin(); II != BB->end(); II++) {
+
+            DbgDeclareInst *pDeclare = dyn_cast<DbgDeclareInst>(II);
+            if (!pDeclare || pDeclare->getVariable()->getName() != sName) {
+                continue;
+            }
+
+            Value *pAddress = pDeclare->getAddress();
+            if (pAddress && isa<AllocaInst>(pAddress)) {
+                LoadInst *pLoad = new LoadInst(pAddress, sName + ".CPI", false, InsertBefore);
+                return pLoad;
+            }
+        }
+    }
+
+    for (Function::arg_iterator AI = pFunction->arg_begin(); AI != pFunction->arg_end(); AI++) {
+        if (AI->getName() == sName) {
+            return &*AI;
+        }
+    }
+
+    return NULL;
+}
+
+void LoopInstrumentor::InlineHookTripCount(Value *pCount, Instruction *InsertBefore) {
+
+    InlineSetRecord(pCount, this->ConstantInt0, this->ConstantInt7, InsertBefore);
+    InlineMemcpy(InsertBefore);
+}
+
+void LoopInstrumentor::InlineHookInputSize(Value *pSize, unsigned uIndex, Instruction *InsertBefore) {
+
+    Value *pValue = NULL;
+
+    if (pSize->getType()->isIntegerTy()) {
+        pValue = CastInst::CreateIntegerCast(pSize, this->LongType, true, "", InsertBefore);
+    } else if (pSize->getType()->isPointerTy()) {
+        pValue = new PtrToIntInst(pSize, this->LongType, "", InsertBefore);
+    } else {
+        errs() << "Input size is neither an integer nor a pointer\n";
+        return;
+    }
+
+    ConstantInt *pIndex = ConstantInt::get(this->IntType, uIndex);
+    InlineSetRecord(pValue, pIndex, this->ConstantInt8, InsertBefore);
+    InlineMemcpy(InsertBefore);
+}
+
 void LoopInstrumentor::InlineSetRecord(Value *address, Value *length, Value *flag, Instruction *InsertBefore) {
 
     std::vector<Value *> ptr_address_indices;
@@ -1062,7 +2880,7 @@ void LoopInstrumentor::InlineSetRecord(Value *address, Value *length, Value *fla
     pStoreFlag->setAlignment(4);
 }
 
-void LoopInstrumentor::InlineMemcpy(Instruction *InsertBefore) {
+void LoopInstrumentor::InlineMemcpy(Instruction *InsertBefore, Value *pStride) {
 
     StoreInst *pStore;
     LoadInst *pLoadPointer;
@@ -1092,16 +2910,161 @@ void LoopInstrumentor::InlineMemcpy(Instruction *InsertBefore) {
     pCall->setAttributes(emptyList);
 
     // iBufferIndex_CPI += 16
-    pBinary = BinaryOperator::Create(Instruction::Add, pLoadIndex, this->ConstantLong16, "iBufferIndex += 16",
-                                     InsertBefore);
+    if (pStride == NULL) {
+        pStride = this->ConstantLong16;
+    }
+    pBinary = BinaryOperator::Create(Instruction::Add, pLoadIndex, pStride, "iBufferIndex += 16", InsertBefore);
     pStore = new StoreInst(pBinary, this->iBufferIndex_CPI, false, InsertBefore);
     pStore->setAlignment(8);
 }
 
-void LoopInstrumentor::InlineHookDelimit(Instruction *InsertBefore) {
+/*
+ * The thread is in a sampled invocation from its delimiter to the exits of the loop, or the return of the
+ * sampled call. With -bAlloc, the allocation hooks only record there.
+ */
+void LoopInstrumentor::InlineSetSampling(ConstantInt *pValue, Instruction *InsertBefore) {
+
+    if (!bAlloc) {
+        return;
+    }
+
+    StoreInst *pStore = new StoreInst(pValue, this->iSampling_CPI, false, InsertBefore);
+    pStore->setAlignment(4);
+}
+
+/*
+ * The delimiter carries the loop_id of the sampled loop in its address, or -1 - func_id of the root when a recursion
+ * is sampled.
+ */
+void LoopInstrumentor::InlineHookDelimit(Instruction *InsertBefore, long lLoopID) {
 
-    InlineSetRecord(this->ConstantLong0, this->ConstantInt0, this->ConstantInt1, InsertBefore);
+    InlineFlushAccesses(InsertBefore);
+
+    if (bDistinct) {
+        CallInst *pReset = CallInst::Create(this->ResetFilter, "", InsertBefore);
+        pReset->setCallingConv(CallingConv::C);
+    }
+
+    InlineSetRecord(ConstantInt::getSigned(this->LongType, lLoopID), this->ConstantInt0, this->ConstantInt1,
+                    InsertBefore);
     InlineMemcpy(InsertBefore);
+    InlineSetSampling(this->ConstantInt1, InsertBefore);
+
+    // each sampled invocation starts with no line seen
+    this->setLineReset.insert(InsertBefore->getParent()->getParent());
+    vector<AllocaInst *> &vecSlots = this->mapLineSlots[InsertBefore->getParent()->getParent()];
+    for (unsigned long i = 0; i < vecSlots.size(); i++) {
+        StoreInst *pReset = new StoreInst(ConstantInt::getSigned(this->LongType, -1), vecSlots[i], false,
+                                          InsertBefore);
+        pReset->setAlignment(8);
+    }
+}
+
+/*
+ * Coalescing mode: the access goes to the runtime, which extends the open run of the thread or writes it
+ * and starts a new one. The site is in the flag, runs of different sites never merge.
+ */
+void LoopInstrumentor::InlineHookCoalesce(Value *pAddress, Value *pLength, ConstantInt *pFlag,
+                                          Instruction *InsertBefore) {
+
+    std::vector<Value *> vecParam;
+    vecParam.push_back(pAddress);
+    vecParam.push_back(pLength);
+    vecParam.push_back(pFlag);
+
+    CallInst *pCall = CallInst::Create(this->CoalesceAccess, vecParam, "", InsertBefore);
+    pCall->setCallingConv(CallingConv::C);
+}
+
+/*
+ * Distinct mode: the runtime drops the addresses already seen in the invocation, see runtime/include/Distinct.h.
+ */
+void LoopInstrumentor::InlineHookDistinct(Value *pAddress, Value *pLength, ConstantInt *pFlag,
+                                          Instruction *InsertBefore) {
+
+    std::vector<Value *> vecParam;
+    vecParam.push_back(pAddress);
+    vecParam.push_back(pLength);
+    vecParam.push_back(pFlag);
+
+    CallInst *pCall = CallInst::Create(this->FilterAccess, vecParam, "", InsertBefore);
+    pCall->setCallingConv(CallingConv::C);
+}
+
+void LoopInstrumentor::InlineFlushAccesses(Instruction *InsertBefore) {
+
+    if (!bCoalesce) {
+        return;
+    }
+
+    CallInst *pCall = CallInst::Create(this->FlushAccesses, "", InsertBefore);
+    pCall->setCallingConv(CallingConv::C);
+}
+
+/*
+ * Cache-line mode: the access is recorded as its 64-byte line, length 512 bits. Each site keeps the line
+ * it recorded last in its own slot, and when the line repeats the record is written but iBufferIndex_CPI
+ * is not advanced, so the next record overwrites it. Sequential scans shrink up to 64 times without a branch.
+ */
+void LoopInstrumentor::InlineHookLine(Value *pAddress, ConstantInt *pFlag, Instruction *InsertBefore) {
+
+    Function *pFunction = InsertBefore->getParent()->getParent();
+    Instruction *pEntry = &*pFunction->getEntryBlock().getFirstInsertionPt();
+
+    // left uninitialized here, see InitLineSlots
+    AllocaInst *pSlot = new AllocaInst(this->LongType, 0, "line.CPI", pEntry);
+    pSlot->setAlignment(8);
+    this->mapLineSlots[pFunction].push_back(pSlot);
+
+    BinaryOperator *pLine = BinaryOperator::Create(Instruction::And, pAddress,
+                                                   ConstantInt::getSigned(this->LongType, -64), "", InsertBefore);
+    LoadInst *pLast = new LoadInst(pSlot, "", false, InsertBefore);
+    pLast->setAlignment(8);
+    ICmpInst *pNew = new ICmpInst(InsertBefore, ICmpInst::ICMP_NE, pLine, pLast, "");
+    StoreInst *pStoreLine = new StoreInst(pLine, pSlot, false, InsertBefore);
+    pStoreLine->setAlignment(8);
+
+    SelectInst *pStride = SelectInst::Create(pNew, this->ConstantLong16, this->ConstantLong0, "", InsertBefore);
+
+    InlineSetRecord(pLine, ConstantInt::get(this->IntType, 512), pFlag, InsertBefore);
+    InlineMemcpy(InsertBefore, pStride);
+}
+
+/*
+ * The slots of a function holding a delimiter are reset there, on the sampled path only. The .CPI callees
+ * have none and start each call with no line seen, so their line state is per call frame: a line the caller
+ * or an earlier call recorded is recorded again.
+ */
+void LoopInstrumentor::InitLineSlots() {
+
+    for (map<Function *, vector<AllocaInst *> >::iterator itFunction = this->mapLineSlots.begin();
+         itFunction != this->mapLineSlots.end(); itFunction++) {
+        if (this->setLineReset.find(itFunction->first) != this->setLineReset.end()) {
+            continue;
+        }
+
+        vector<AllocaInst *> &vecSlots = itFunction->second;
+        for (unsigned long i = 0; i < vecSlots.size(); i++) {
+            StoreInst *pInit = new StoreInst(ConstantInt::getSigned(this->LongType, -1), vecSlots[i], false,
+                                             vecSlots[i]->getNextNode());
+            pInit->setAlignment(8);
+        }
+    }
+}
+
+/*
+ * Loads and stores keep the ins_id of their site, plus one, in the upper bits of the flag, 0 when the
+ * instruction has none. The flag stays a constant.
+ */
+ConstantInt *LoopInstrumentor::GetSiteFlag(ConstantInt *pKind, Instruction *pInst) {
+
+    int iSite = GetInstructionID(pInst);
+    if (iSite < 0) {
+        return pKind;
+    }
+
+    uint64_t uFlag = pKind->getZExtValue() | ((((uint64_t)iSite + 1) & 0xFFFFFF) << 8);
+    return ConstantInt::get(this->IntType, uFlag);
 }
 
 void LoopInstrumentor::InlineHookLoad(LoadInst *pLoad, Instruction *InsertBefore) {
@@ -1114,9 +3077,18 @@ void LoopInstrumentor::InlineHookLoad(LoadInst *pLoad, Instruction *InsertBefore
         ConstantInt *const_length = ConstantInt::get(this->pModule->getContext(), APInt(32, StringRef(
                 std::to_string(dl->getTypeAllocSizeInBits(type_1))), 10));
         CastInst *int64_address = new PtrToIntInst(var, this->LongType, "", InsertBefore);
-
-        InlineSetRecord(int64_address, const_length, this->ConstantInt2, InsertBefore);
-        InlineMemcpy(InsertBefore);
+        ConstantInt *pFlag = GetSiteFlag(this->ConstantInt2, pLoad);
+
+        if (bCacheLine) {
+            InlineHookLine(int64_address, pFlag, InsertBefore);
+        } else if (bCoalesce) {
+            InlineHookCoalesce(int64_address, const_length, pFlag, InsertBefore);
+        } else if (bDistinct) {
+            InlineHookDistinct(int64_address, const_length, pFlag, InsertBefore);
+        } else {
+            InlineSetRecord(int64_address, const_length, pFlag, InsertBefore);
+            InlineMemcpy(InsertBefore);
+        }
 
     } else {
         pLoad->dump();
@@ -1125,6 +3097,34 @@ void LoopInstrumentor::InlineHookLoad(LoadInst *pLoad, Instruction *InsertBefore
     }
 }
 
+/*
+ * Atomic and volatile accesses are the ones other threads contend on. The thread ID goes in the upper bits
+ * of the flag. The record is appended like any other: the trace has a single writer, see Record.h.
+ */
+void LoopInstrumentor::InlineHookShared(Value *pPointer, ConstantInt *pKind, Instruction *InsertBefore) {
+
+    const DataLayout &DL = this->pModule->getDataLayout();
+    Type *type_1 = pPointer->getType()->getContainedType(0);
+
+    if (!type_1->isSized()) {
+        return;
+    }
+
+    ConstantInt *const_length = ConstantInt::get(this->IntType, DL.getTypeAllocSizeInBits(type_1));
+    CastInst *int64_address = new PtrToIntInst(pPointer, this->LongType, "", InsertBefore);
+
+    // flag = kind | thread << 8
+    CallInst *pThread = CallInst::Create(this->GetThreadID, "", InsertBefore);
+    pThread->setCallingConv(CallingConv::C);
+    BinaryOperator *pShift = BinaryOperator::Create(Instruction::Shl, pThread, this->ConstantInt8, "", InsertBefore);
+    BinaryOperator *pFlag = BinaryOperator::Create(Instruction::Or, pShift, pKind, "", InsertBefore);
+
+    // an open run of -bCoalesce comes before
+    InlineFlushAccesses(InsertBefore);
+    InlineSetRecord(int64_address, const_length, pFlag, InsertBefore);
+    InlineMemcpy(InsertBefore);
+}
+
 void LoopInstrumentor::InlineHookStore(StoreInst *pStore, Instruction *InsertBefore) {
 
     Value *var = pStore->getOperand(1);
@@ -1135,9 +3135,18 @@ void LoopInstrumentor::InlineHookStore(StoreInst *pStore, Instruction *InsertBef
         ConstantInt *const_length = ConstantInt::get(this->pModule->getContext(), APInt(32, StringRef(
                 std::to_string(dl->getTypeAllocSizeInBits(type_1))), 10));
         CastInst *int64_address = new PtrToIntInst(var, this->LongType, "", InsertBefore);
-
-        InlineSetRecord(int64_address, const_length, this->ConstantInt3, InsertBefore);
-        InlineMemcpy(InsertBefore);
+        ConstantInt *pFlag = GetSiteFlag(this->ConstantInt3, pStore);
+
+        if (bCacheLine) {
+            InlineHookLine(int64_address, pFlag, InsertBefore);
+        } else if (bCoalesce) {
+            InlineHookCoalesce(int64_address, const_length, pFlag, InsertBefore);
+        } else if (bDistinct) {
+            InlineHookDistinct(int64_address, const_length, pFlag, InsertBefore);
+        } else {
+            InlineSetRecord(int64_address, const_length, pFlag, InsertBefore);
+            InlineMemcpy(InsertBefore);
+        }
 
     } else {
         pStore->dump();
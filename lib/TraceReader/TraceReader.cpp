@@ -0,0 +1,352 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "TraceReader/TraceReader.h"
+
+using namespace std;
+
+static const char g_IndexMagic[8] = {'N', 'C', 'A', 'I', 'D', 'X', '0', '1'};
+
+struct stIndexHeader {
+    char szMagic[8];
+    uint64_t uTraceBytes;
+    int64_t lTraceTime;
+    uint64_t uEntries;
+};
+
+InvocationIterator::InvocationIterator(const stMemRecord *pDelimiter, const stMemRecord *pTraceEnd)
+        : pCurrent(pDelimiter), pNext(pTraceEnd), pEnd(pTraceEnd) {
+
+    if (pCurrent != pEnd) {
+        pNext = SearchDelimiter(pCurrent + 1);
+    }
+}
+
+InvocationIterator &InvocationIterator::operator++() {
+
+    pCurrent = pNext;
+    if (pCurrent != pEnd) {
+        pNext = SearchDelimiter(pCurrent + 1);
+    }
+    return *this;
+}
+
+const stMemRecord *InvocationIterator::SearchDelimiter(const stMemRecord *pFrom) const {
+
+    for (; pFrom != pEnd; pFrom++) {
+        if (RECORD_KIND(pFrom->flag) == RECORD_DELIMIT) {
+            break;
+        }
+    }
+    return pFrom;
+}
+
+TraceReader::TraceReader() : pRecords(NULL), uRecords(0), pMap(NULL), uMapSize(0), bShm(false), uTraceBytes(0),
+                             lTraceTime(0) {
+}
+
+TraceReader::~TraceReader() {
+    Close();
+}
+
+bool TraceReader::OpenShm(const string &sName) {
+
+    int fd = shm_open(sName.c_str(), O_RDONLY, 0);
+    if (fd == -1) {
+        sError = "shm_open " + sName + " failed: " + strerror(errno);
+        return false;
+    }
+
+    if (!Map(fd, sName)) {
+        return false;
+    }
+    this->sName = sName;
+    this->bShm = true;
+    return true;
+}
+
+bool TraceReader::OpenFile(const string &sPath) {
+
+    int fd = open(sPath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        sError = "open " + sPath + " failed: " + strerror(errno);
+        return false;
+    }
+
+    if (!Map(fd, sPath)) {
+        return false;
+    }
+    this->sName = sPath;
+    this->bShm = false;
+    return true;
+}
+
+bool TraceReader::Map(int fd, const string &sName) {
+
+    Close();
+
+    struct stat Stat;
+    if (fstat(fd, &Stat) == -1) {
+        sError = "fstat " + sName + " failed: " + strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    uTraceBytes = (uint64_t)Stat.st_size;
+    lTraceTime = (int64_t)Stat.st_mtim.tv_sec * 1000000000 + Stat.st_mtim.tv_nsec;
+
+    uMapSize = (size_t)Stat.st_size / sizeof(stMemRecord) * sizeof(stMemRecord);
+    if (uMapSize == 0) {
+        close(fd);
+        return true;
+    }
+
+    pMap = mmap(NULL, uMapSize, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid once the descriptor is closed
+    close(fd);
+
+    if (pMap == MAP_FAILED) {
+        sError = "mmap " + sName + " failed: " + strerror(errno);
+        pMap = NULL;
+        uMapSize = 0;
+        return false;
+    }
+
+    // hints only: readahead for the linear scans, huge pages where the file system backs them (shmem)
+    madvise(pMap, uMapSize, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(pMap, uMapSize, MADV_HUGEPAGE);
+#endif
+
+    pRecords = (const stMemRecord *)pMap;
+    uRecords = uMapSize / sizeof(stMemRecord);
+
+    // a finalized trace is truncated to its last record. The buffer of a run that did not reach FinalizeMemHooks
+    // is zero past its last record: records are written in order, so the first end record is bisected for
+    // without touching the untouched tail of the mapping
+    if (uRecords > 0 && RECORD_KIND(pRecords[uRecords - 1].flag) == RECORD_END) {
+        size_t uLow = 0;
+        size_t uHigh = uRecords - 1;
+        while (uLow < uHigh) {
+            size_t uMiddle = uLow + (uHigh - uLow) / 2;
+            if (RECORD_KIND(pRecords[uMiddle].flag) == RECORD_END) {
+                uHigh = uMiddle;
+            } else {
+                uLow = uMiddle + 1;
+            }
+        }
+        uRecords = uLow;
+    }
+
+    return true;
+}
+
+void TraceReader::Close() {
+
+    if (pMap != NULL) {
+        munmap(pMap, uMapSize);
+    }
+
+    pMap = NULL;
+    uMapSize = 0;
+    pRecords = NULL;
+    uRecords = 0;
+    sName.clear();
+}
+
+const stMemRecord &TraceReader::At(size_t uIndex) const {
+
+    if (uIndex >= uRecords) {
+        fprintf(stderr, "record %lu out of a trace of %lu\n", (unsigned long)uIndex, (unsigned long)uRecords);
+        abort();
+    }
+    return pRecords[uIndex];
+}
+
+InvocationIterator TraceReader::BeginInvocations() const {
+
+    const stMemRecord *pFirst = begin();
+    while (pFirst != end() && RECORD_KIND(pFirst->flag) != RECORD_DELIMIT) {
+        pFirst++;
+    }
+    return InvocationIterator(pFirst, end());
+}
+
+InvocationIterator TraceReader::EndInvocations() const {
+    return InvocationIterator(end(), end());
+}
+
+Invocation TraceReader::GetInvocation(vector<size_t> &vecDelimiters, size_t uIndex) const {
+
+    if (uIndex + 1 >= vecDelimiters.size() || vecDelimiters[uIndex + 1] > uRecords) {
+        fprintf(stderr, "invocation %lu out of %lu\n", (unsigned long)uIndex,
+                (unsigned long)(vecDelimiters.empty() ? 0 : vecDelimiters.size() - 1));
+        abort();
+    }
+    return Invocation(pRecords + vecDelimiters[uIndex] + 1, pRecords + vecDelimiters[uIndex + 1]);
+}
+
+void TraceReader::SearchDelimiters(vector<size_t> &vecDelimiters, unsigned uThreads) const {
+
+    if (uThreads == 0) {
+        uThreads = 1;
+    }
+
+    vector<vector<size_t> > vecSlices(uThreads);
+    vector<thread> vecThreads;
+
+    size_t uSlice = (uRecords + uThreads - 1) / uThreads;
+
+    for (unsigned t = 0; t < uThreads; t++) {
+        vecThreads.push_back(thread([&, t]() {
+            size_t uBegin = min(uRecords, t * uSlice);
+            size_t uEnd = min(uRecords, uBegin + uSlice);
+
+            for (size_t i = uBegin; i < uEnd; i++) {
+                if (RECORD_KIND(pRecords[i].flag) == RECORD_DELIMIT) {
+                    vecSlices[t].push_back(i);
+                }
+            }
+        }));
+    }
+
+    for (unsigned t = 0; t < uThreads; t++) {
+        vecThreads[t].join();
+        vecDelimiters.insert(vecDelimiters.end(), vecSlices[t].begin(), vecSlices[t].end());
+    }
+
+    vecDelimiters.push_back(uRecords);
+}
+
+bool TraceReader::LoadIndex(vector<stIndexEntry> &vecIndex, unsigned uThreads) {
+
+    vecIndex.clear();
+
+    if (ReadIndex(vecIndex)) {
+        return true;
+    }
+
+    vector<size_t> vecDelimiters;
+    SearchDelimiters(vecDelimiters, uThreads);
+
+    for (size_t i = 0; i + 1 < vecDelimiters.size(); i++) {
+        stIndexEntry Entry;
+        Entry.uDelimiter = vecDelimiters[i];
+        Entry.uSequence = i;
+        Entry.lLoopID = (int64_t)pRecords[vecDelimiters[i]].address;
+        Entry.uRecords = vecDelimiters[i + 1] - vecDelimiters[i] - 1;
+        vecIndex.push_back(Entry);
+    }
+
+    // an index that cannot be written is only rebuilt next time
+    WriteIndex(vecIndex);
+    return true;
+}
+
+Invocation TraceReader::GetInvocation(const stIndexEntry &Entry) const {
+
+    if (Entry.uDelimiter >= uRecords || Entry.uRecords > uRecords - Entry.uDelimiter - 1) {
+        fprintf(stderr, "invocation %lu out of a trace of %lu records\n", (unsigned long)Entry.uSequence,
+                (unsigned long)uRecords);
+        abort();
+    }
+    return Invocation(pRecords + Entry.uDelimiter + 1, pRecords + Entry.uDelimiter + 1 + Entry.uRecords);
+}
+
+int TraceReader::OpenIndex(int iFlags) {
+
+    if (sName.empty()) {
+        return -1;
+    }
+
+    string sIndex = sName + ".idx";
+    return bShm ? shm_open(sIndex.c_str(), iFlags, 0644) : open(sIndex.c_str(), iFlags, 0644);
+}
+
+static bool ReadAll(int fd, void *pBuffer, size_t uBytes) {
+
+    char *pCursor = (char *)pBuffer;
+    while (uBytes > 0) {
+        ssize_t lRead = read(fd, pCursor, uBytes);
+        if (lRead <= 0) {
+            return false;
+        }
+        pCursor += lRead;
+        uBytes -= lRead;
+    }
+    return true;
+}
+
+static bool WriteAll(int fd, const void *pBuffer, size_t uBytes) {
+
+    const char *pCursor = (const char *)pBuffer;
+    while (uBytes > 0) {
+        ssize_t lWritten = write(fd, pCursor, uBytes);
+        if (lWritten <= 0) {
+            return false;
+        }
+        pCursor += lWritten;
+        uBytes -= lWritten;
+    }
+    return true;
+}
+
+bool TraceReader::ReadIndex(vector<stIndexEntry> &vecIndex) {
+
+    int fd = OpenIndex(O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    stIndexHeader Header;
+    bool bValid = ReadAll(fd, &Header, sizeof(Header)) && memcmp(Header.szMagic, g_IndexMagic, 8) == 0 &&
+                  Header.uTraceBytes == uTraceBytes && Header.lTraceTime == lTraceTime &&
+                  Header.uEntries <= uRecords;
+
+    if (bValid) {
+        vecIndex.resize(Header.uEntries);
+        bValid = Header.uEntries == 0 || ReadAll(fd, &vecIndex[0], Header.uEntries * sizeof(stIndexEntry));
+    }
+
+    for (size_t i = 0; bValid && i < vecIndex.size(); i++) {
+        bValid = vecIndex[i].uDelimiter < uRecords && vecIndex[i].uRecords <= uRecords - vecIndex[i].uDelimiter - 1;
+    }
+
+    close(fd);
+
+    if (!bValid) {
+        vecIndex.clear();
+    }
+    return bValid;
+}
+
+void TraceReader::WriteIndex(vector<stIndexEntry> &vecIndex) {
+
+    int fd = OpenIndex(O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd == -1) {
+        return;
+    }
+
+    stIndexHeader Header;
+    memcpy(Header.szMagic, g_IndexMagic, 8);
+    Header.uTraceBytes = uTraceBytes;
+    Header.lTraceTime = lTraceTime;
+    Header.uEntries = vecIndex.size();
+
+    if (!WriteAll(fd, &Header, sizeof(Header)) ||
+        (!vecIndex.empty() && !WriteAll(fd, &vecIndex[0], vecIndex.size() * sizeof(stIndexEntry)))) {
+        // a partial index would not be read back, its header is checked first
+        ftruncate(fd, 0);
+    }
+
+    close(fd);
+}
@@ -0,0 +1,23 @@
+// allocation tracking
+
+#ifndef NEWCOMAIR_RUNTIME_ALLOC_H
+#define NEWCOMAIR_RUNTIME_ALLOC_H
+
+/**
+ * AllocLib interposes malloc, calloc, realloc, memalign, aligned_alloc, posix_memalign, valloc and free. It is
+ * linked, ahead of libc, only into programs whose module was instrumented with -bAlloc, and clashes with a
+ * program that defines its own allocator.
+ * The allocations, moves and releases a thread makes inside its sampled invocation are written to the trace
+ * (RECORD_ALLOC, RECORD_REALLOC, RECORD_FREE). The analyzer numbers the objects from these records, so that
+ * accesses can be expressed as (object ID, offset); realloc keeps the ID of the object.
+ * Outside sampled invocations the hooks go straight to libc: an object allocated or moved there is not tracked,
+ * and its accesses keep their raw addresses. A buffer grown between two invocations of a loop is then seen at
+ * two unrelated addresses.
+ */
+
+/**
+ * Non-zero while the thread is in a sampled invocation, defined and set by a module instrumented with -bAlloc.
+ */
+extern __thread int iSampling_CPI;
+
+#endif //NEWCOMAIR_RUNTIME_ALLOC_H
@@ -0,0 +1,22 @@
+// access coalescing
+
+#ifndef NEWCOMAIR_RUNTIME_COALESCE_H
+#define NEWCOMAIR_RUNTIME_COALESCE_H
+
+/**
+ * Record a load or store, merged with the open run of the thread when it comes from the same site and its
+ * bytes are adjacent to the run, forward or backward. Any other access writes the run first, so the records
+ * keep the program order of the accesses.
+ * @param uAddress address of the access.
+ * @param uLength length of the access in bits.
+ * @param uFlag RECORD_LOAD or RECORD_STORE, with the site in the upper bits.
+ */
+void CoalesceAccess(unsigned long uAddress, unsigned int uLength, unsigned int uFlag);
+
+/**
+ * Write the open run of the calling thread, before a delimiter, a marker, a record written elsewhere or the
+ * end of the trace. Returns at once when no run is open.
+ */
+void FlushAccesses();
+
+#endif //NEWCOMAIR_RUNTIME_COALESCE_H
@@ -0,0 +1,22 @@
+// distinct-address filter
+
+#ifndef NEWCOMAIR_RUNTIME_DISTINCT_H
+#define NEWCOMAIR_RUNTIME_DISTINCT_H
+
+/**
+ * Record a load or store only if its address was not accessed yet with the same length and kind in the current
+ * sampled invocation.
+ * A direct-mapped cache of recent addresses answers most repeats, a Bloom filter the rest. A false positive
+ * of the filter drops a new address, which makes the distinct count a slight underestimate.
+ * @param uAddress address of the access.
+ * @param uLength length of the access in bits.
+ * @param uFlag RECORD_LOAD or RECORD_STORE.
+ */
+void FilterAccess(unsigned long uAddress, unsigned int uLength, unsigned int uFlag);
+
+/**
+ * Forget the addresses seen, at the start of each sampled invocation.
+ */
+void ResetFilter();
+
+#endif //NEWCOMAIR_RUNTIME_DISTINCT_H
@@ -0,0 +1,61 @@
+// trace records
+
+#ifndef NEWCOMAIR_RUNTIME_RECORD_H
+#define NEWCOMAIR_RUNTIME_RECORD_H
+
+/**
+ * One 16-byte record of the shared memory trace, as written by the instrumented code and the runtime.
+ * Lengths of memory accesses are in bits.
+ * The trace has a single writer: the thread in the sampled invocation appends through Record_CPI and a plain
+ * update of iBufferIndex_CPI, and so do the runtime hooks it calls. Two threads in sampled code at once,
+ * e.g. a sampled loop whose cloned callees run on other threads, overwrite each other's records.
+ */
+typedef struct stMemRecord {
+    unsigned long address;
+    unsigned int length;
+    unsigned int flag;
+} stMemRecord;
+
+/**
+ * Record flags, what address and length hold for each.
+ * With -bCacheLine, loads and stores hold the 64-byte line (address aligned down, length 512), and a line
+ * is not repeated while a site keeps touching it.
+ * With -bCoalesce, a load or store covers a run of adjacent accesses of one site. The run is written as soon as
+ * another access comes, so the records stay in program order.
+ * With -bDistinct, only the first load and the first store of each address in an invocation are recorded.
+ */
+enum {
+    RECORD_END = 0,                 // end of the trace
+    RECORD_DELIMIT = 1,             // start of a sampled invocation, loop_id in address (-1 - root func_id if recursive)
+    RECORD_LOAD = 2,                // address, length
+    RECORD_STORE = 3,               // address, length
+    RECORD_MEMCPY = 4,
+    RECORD_MEMMOVE = 5,
+    RECORD_COST = 6,                // cost of the invocation in address
+    RECORD_TRIP_COUNT = 7,          // trip count in address
+    RECORD_INPUT_SIZE = 8,          // value in address, index of the input in length
+    RECORD_CALLEE_ARGUMENT = 9,     // pointer passed to a callee that was not cloned, size of its type, not an access
+    RECORD_INDIRECT_TARGET = 10,    // called address - &main (raw if no main), ins_id of the call site in length
+    RECORD_LOOP_ITERATION = 11,     // loop_id in address, nesting level in length
+    RECORD_ALLOC = 12,              // base, size in bytes: a new object, IDs are given in the order of these records
+    RECORD_FREE = 13,               // base of the object
+    RECORD_REALLOC = 14,            // new base, size in bytes: the object freed by the previous record, moved
+    RECORD_SHARED_LOAD = 15,        // address, length: atomic or volatile load
+    RECORD_SHARED_STORE = 16,       // address, length: atomic or volatile store
+    RECORD_SHARED_RMW = 17,         // address, length: atomicrmw, cmpxchg
+};
+
+/**
+ * The shared accesses (15 to 17) carry the ID of the thread in the upper bits of the flag.
+ * Loads and stores carry the ins_id of their site plus one there, 0 when it is unknown.
+ */
+#define RECORD_KIND_MASK 0xFFU
+
+#define RECORD_THREAD_SHIFT 8
+#define RECORD_THREAD_MASK 0xFFFFFFU
+
+#define RECORD_KIND(flag) ((flag) & RECORD_KIND_MASK)
+#define RECORD_THREAD(flag) (((flag) >> RECORD_THREAD_SHIFT) & RECORD_THREAD_MASK)
+#define RECORD_SITE(flag) ((long)RECORD_THREAD(flag) - 1)
+
+#endif //NEWCOMAIR_RUNTIME_RECORD_H
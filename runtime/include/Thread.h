@@ -0,0 +1,12 @@
+// thread attribution
+
+#ifndef NEWCOMAIR_RUNTIME_THREAD_H
+#define NEWCOMAIR_RUNTIME_THREAD_H
+
+/**
+ * Small sequential ID of the calling thread, given on its first call, stored in the upper bits of the record flag.
+ * @return the thread ID.
+ */
+unsigned int GetThreadID();
+
+#endif //NEWCOMAIR_RUNTIME_THREAD_H
@@ -0,0 +1,124 @@
+//
+// Allocation tracking
+//
+
+#include "Alloc.h"
+#include "Coalesce.h"
+#include "Record.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void __libc_free(void *ptr);
+
+// the trace buffer, defined by the instrumented module
+extern char *pcBuffer_CPI __attribute__((weak));
+extern unsigned long iBufferIndex_CPI __attribute__((weak));
+
+// set at the delimiter of a sampled invocation, cleared at its exits, defined by a module instrumented with -bAlloc
+extern __thread int iSampling_CPI;
+
+static int IsTracing() {
+    return iSampling_CPI && &pcBuffer_CPI != NULL && &iBufferIndex_CPI != NULL && pcBuffer_CPI != NULL;
+}
+
+/**
+ * Only the thread in the sampled invocation writes records, so the index is bumped as the inline hooks do.
+ */
+static void WriteRecord(unsigned long uAddress, unsigned long uLength, unsigned int uFlag) {
+    // the accesses made so far to the object come before its release
+    FlushAccesses();
+
+    stMemRecord Record;
+    Record.address = uAddress;
+    Record.length = uLength > 0xFFFFFFFFUL ? 0xFFFFFFFFU : (unsigned int)uLength;
+    Record.flag = uFlag;
+
+    unsigned long uIndex = iBufferIndex_CPI;
+    memcpy(pcBuffer_CPI + uIndex, &Record, sizeof(stMemRecord));
+    iBufferIndex_CPI = uIndex + sizeof(stMemRecord);
+}
+
+void *malloc(size_t size) {
+    void *pBase = __libc_malloc(size);
+    if (pBase != NULL && IsTracing()) {
+        WriteRecord((unsigned long)pBase, size, RECORD_ALLOC);
+    }
+    return pBase;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    void *pBase = __libc_calloc(nmemb, size);
+    if (pBase != NULL && IsTracing()) {
+        WriteRecord((unsigned long)pBase, nmemb * size, RECORD_ALLOC);
+    }
+    return pBase;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    void *pBase = __libc_memalign(alignment, size);
+    if (pBase != NULL && IsTracing()) {
+        WriteRecord((unsigned long)pBase, size, RECORD_ALLOC);
+    }
+    return pBase;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+
+    void *pBase = memalign(alignment, size);
+    if (pBase == NULL) {
+        return ENOMEM;
+    }
+    *memptr = pBase;
+    return 0;
+}
+
+void *valloc(size_t size) {
+    void *pBase = __libc_valloc(size);
+    if (pBase != NULL && IsTracing()) {
+        WriteRecord((unsigned long)pBase, size, RECORD_ALLOC);
+    }
+    return pBase;
+}
+
+void *realloc(void *ptr, size_t size) {
+    void *pBase = __libc_realloc(ptr, size);
+    if (!IsTracing()) {
+        return pBase;
+    }
+
+    if (ptr == NULL) {
+        if (pBase != NULL) {
+            WriteRecord((unsigned long)pBase, size, RECORD_ALLOC);
+        }
+    } else if (pBase != NULL) {
+        WriteRecord((unsigned long)ptr, 0, RECORD_FREE);
+        WriteRecord((unsigned long)pBase, size, RECORD_REALLOC);
+    } else if (size == 0) {
+        WriteRecord((unsigned long)ptr, 0, RECORD_FREE);
+    }
+    // otherwise the old block is still valid
+
+    return pBase;
+}
+
+void free(void *ptr) {
+    if (ptr != NULL && IsTracing()) {
+        WriteRecord((unsigned long)ptr, 0, RECORD_FREE);
+    }
+    __libc_free(ptr);
+}
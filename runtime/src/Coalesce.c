@@ -0,0 +1,72 @@
+//
+// Access coalescing
+//
+
+#include "Coalesce.h"
+#include "Record.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// the trace buffer, defined by the instrumented module
+extern char *pcBuffer_CPI __attribute__((weak));
+extern unsigned long iBufferIndex_CPI __attribute__((weak));
+
+// the length of a record is in bits and has 32 of them
+#define MAX_RUN_BYTES (0xFFFFFFFFUL / 8)
+
+typedef struct stRun {
+    unsigned long uStart;
+    unsigned long uBytes;
+    unsigned int uFlag;
+} stRun;
+
+// the open run of the thread, empty when uBytes is 0
+static __thread stRun g_Run;
+
+static void WriteRun(stRun *pRun) {
+    if (pRun->uBytes == 0 || &pcBuffer_CPI == NULL || pcBuffer_CPI == NULL) {
+        pRun->uBytes = 0;
+        return;
+    }
+
+    stMemRecord Record;
+    Record.address = pRun->uStart;
+    Record.length = (unsigned int)(pRun->uBytes * 8);
+    Record.flag = pRun->uFlag;
+
+    // only the thread in the sampled invocation writes, as the inline hooks do
+    unsigned long uIndex = iBufferIndex_CPI;
+    memcpy(pcBuffer_CPI + uIndex, &Record, sizeof(stMemRecord));
+    iBufferIndex_CPI = uIndex + sizeof(stMemRecord);
+
+    pRun->uBytes = 0;
+}
+
+void CoalesceAccess(unsigned long uAddress, unsigned int uLength, unsigned int uFlag) {
+    stRun *pRun = &g_Run;
+    unsigned long uBytes = (uLength + 7) / 8;
+
+    // only adjacent bytes of the same site and kind are merged, a repeated access stays a record of its own
+    if (pRun->uBytes != 0 && pRun->uFlag == uFlag && pRun->uBytes + uBytes <= MAX_RUN_BYTES) {
+        if (uAddress == pRun->uStart + pRun->uBytes) {
+            pRun->uBytes += uBytes;
+            return;
+        }
+        if (uAddress + uBytes == pRun->uStart) {
+            pRun->uStart = uAddress;
+            pRun->uBytes += uBytes;
+            return;
+        }
+    }
+
+    WriteRun(pRun);
+
+    pRun->uStart = uAddress;
+    pRun->uBytes = uBytes;
+    pRun->uFlag = uFlag;
+}
+
+void FlushAccesses() {
+    WriteRun(&g_Run);
+}
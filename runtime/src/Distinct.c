@@ -0,0 +1,116 @@
+//
+// Distinct-address filter
+//
+
+#include "Distinct.h"
+#include "Record.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// the trace buffer, defined by the instrumented module
+extern char *pcBuffer_CPI __attribute__((weak));
+extern unsigned long iBufferIndex_CPI __attribute__((weak));
+
+// direct-mapped cache of the recent addresses
+#define CACHE_BITS 10
+#define CACHE_SIZE (1UL << CACHE_BITS)
+
+// the Bloom filter, 2^20 bits and 3 probes: (1 - e^(-3n / 2^20))^3 false positives, 0.24% at n = 50k distinct
+// accesses, 1.5% at 100k
+#define FILTER_BITS 20
+#define FILTER_WORDS ((1UL << FILTER_BITS) / 64)
+#define FILTER_PROBES 3
+
+typedef struct stAccess {
+    unsigned long uKey;
+    unsigned int uLength;
+} stAccess;
+
+typedef struct stFilter {
+    stAccess arrCache[CACHE_SIZE];
+    unsigned long arrWords[FILTER_WORDS];
+    // words set since the last reset, cleared alone when the invocation was small
+    unsigned int arrDirty[FILTER_WORDS];
+    unsigned long uDirty;
+} stFilter;
+
+static __thread stFilter g_Filter;
+
+static unsigned long Mix(unsigned long uKey) {
+    uKey ^= uKey >> 33;
+    uKey *= 0xFF51AFD7ED558CCDUL;
+    uKey ^= uKey >> 33;
+    uKey *= 0xC4CEB9FE1A85EC53UL;
+    uKey ^= uKey >> 33;
+    return uKey;
+}
+
+/**
+ * Test and set the bits of a hashed key, returns whether all were set already.
+ */
+static int TestAndSet(unsigned long uHash) {
+    int bSeen = 1;
+
+    for (int i = 0; i < FILTER_PROBES; i++) {
+        unsigned long uBit = (uHash >> (i * FILTER_BITS)) & ((1UL << FILTER_BITS) - 1);
+        unsigned long *pWord = &g_Filter.arrWords[uBit / 64];
+        unsigned long uMask = 1UL << (uBit % 64);
+
+        if (*pWord & uMask) {
+            continue;
+        }
+
+        bSeen = 0;
+        if (*pWord == 0 && g_Filter.uDirty < FILTER_WORDS) {
+            g_Filter.arrDirty[g_Filter.uDirty++] = (unsigned int)(uBit / 64);
+        }
+        *pWord |= uMask;
+    }
+
+    return bSeen;
+}
+
+void FilterAccess(unsigned long uAddress, unsigned int uLength, unsigned int uFlag) {
+    // the same address read and written are two accesses to keep, and so are a narrow and a wide access there
+    unsigned long uKey = (uAddress << 1) | (RECORD_KIND(uFlag) == RECORD_STORE);
+    unsigned long uHash = Mix(uKey ^ Mix(uLength));
+
+    // length 0 is the empty slot, a zero-length access is never cached
+    stAccess *pSlot = &g_Filter.arrCache[uHash & (CACHE_SIZE - 1)];
+    if (pSlot->uKey == uKey && pSlot->uLength == uLength && uLength != 0) {
+        return;
+    }
+    pSlot->uKey = uKey;
+    pSlot->uLength = uLength;
+
+    if (TestAndSet(uHash)) {
+        return;
+    }
+
+    if (&pcBuffer_CPI == NULL || pcBuffer_CPI == NULL) {
+        return;
+    }
+
+    stMemRecord Record;
+    Record.address = uAddress;
+    Record.length = uLength;
+    Record.flag = uFlag;
+
+    memcpy(pcBuffer_CPI + iBufferIndex_CPI, &Record, sizeof(stMemRecord));
+    iBufferIndex_CPI += sizeof(stMemRecord);
+}
+
+void ResetFilter() {
+    memset(g_Filter.arrCache, 0, sizeof(g_Filter.arrCache));
+
+    // a full dirty list means too many words to clear one by one
+    if (g_Filter.uDirty == FILTER_WORDS) {
+        memset(g_Filter.arrWords, 0, sizeof(g_Filter.arrWords));
+    } else {
+        for (unsigned long i = 0; i < g_Filter.uDirty; i++) {
+            g_Filter.arrWords[g_Filter.arrDirty[i]] = 0;
+        }
+    }
+    g_Filter.uDirty = 0;
+}
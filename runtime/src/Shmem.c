@@ -44,6 +44,7 @@ char* InitMemHooks() {
 
 /**
  * Truncate the shared memory buffer to the actual data size, then close.
+ * No end record is written, the reader takes the size as the end of the trace.
  */
 void FinalizeMemHooks(unsigned long iBufferIndex) {
     if (ftruncate(fd, iBufferIndex) == -1) {
@@ -0,0 +1,22 @@
+//
+// Thread attribution
+//
+
+#include "Thread.h"
+#include "Record.h"
+
+// IDs of the threads are taken in the order of their first shared access
+static unsigned int g_NextThreadID = 0;
+
+// 0 until the thread gets its ID, then ID + 1
+static __thread unsigned int g_ThreadID = 0;
+
+/**
+ * Small sequential ID of the calling thread, given on its first call.
+ */
+unsigned int GetThreadID() {
+    if (g_ThreadID == 0) {
+        g_ThreadID = __atomic_fetch_add(&g_NextThreadID, 1, __ATOMIC_RELAXED) + 1;
+    }
+    return (g_ThreadID - 1) & RECORD_THREAD_MASK;
+}
@@ -0,0 +1,258 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+#include "Distinct.h"
+
+using namespace std;
+
+// below this many accesses, hashing beats the passes of the sort
+#define SORT_THRESHOLD 4096
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+// the cell starts at bit 2 and stays below bit 64
+#define MAX_PASSES 8
+
+static const uint64_t EMPTY = ~0ULL;
+
+static uint64_t Hash(uint64_t uKey) {
+    uKey ^= uKey >> 33;
+    uKey *= 0xFF51AFD7ED558CCDULL;
+    uKey ^= uKey >> 33;
+    return uKey;
+}
+
+CellSet::CellSet() : uSize(0) {
+    vecKeys.assign(1 << 12, EMPTY);
+}
+
+bool CellSet::Insert(uint64_t uCell) {
+
+    if ((uSize + 1) * 2 > vecKeys.size()) {
+        Grow();
+    }
+
+    uint64_t uMask = vecKeys.size() - 1;
+    uint64_t uSlot = Hash(uCell) & uMask;
+
+    while (vecKeys[uSlot] != EMPTY) {
+        if (vecKeys[uSlot] == uCell) {
+            return false;
+        }
+        uSlot = (uSlot + 1) & uMask;
+    }
+
+    vecKeys[uSlot] = uCell;
+    uSize++;
+    return true;
+}
+
+void CellSet::Clear() {
+
+    // a table grown for one large invocation is not swept for every small one after it
+    if (vecKeys.size() > (1 << 12) && uSize * 8 < vecKeys.size()) {
+        vector<uint64_t>(1 << 12, EMPTY).swap(vecKeys);
+    } else {
+        fill(vecKeys.begin(), vecKeys.end(), EMPTY);
+    }
+    uSize = 0;
+}
+
+void CellSet::Grow() {
+
+    vector<uint64_t> vecOld(vecKeys.size() * 2, EMPTY);
+    vecOld.swap(vecKeys);
+    uSize = 0;
+
+    for (size_t i = 0; i < vecOld.size(); i++) {
+        if (vecOld[i] != EMPTY) {
+            Insert(vecOld[i]);
+        }
+    }
+}
+
+/*
+ * Histograms of all the digits in one read of the keys.
+ */
+static void HistogramScalar(const uint64_t *pKeys, size_t uCount, unsigned uPasses,
+                            uint64_t arrHist[][RADIX_SIZE]) {
+
+    for (size_t i = 0; i < uCount; i++) {
+        for (unsigned p = 0; p < uPasses; p++) {
+            arrHist[p][(pKeys[i] >> (2 + p * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void HistogramAVX2(const uint64_t *pKeys, size_t uCount, unsigned uPasses,
+                          uint64_t arrHist[][RADIX_SIZE]) {
+
+    const __m256i vMask = _mm256_set1_epi64x(RADIX_SIZE - 1);
+    alignas(32) uint64_t arrDigits[4];
+
+    size_t i = 0;
+    for (; i + 4 <= uCount; i += 4) {
+        __m256i vKeys = _mm256_loadu_si256((const __m256i *)(pKeys + i));
+
+        for (unsigned p = 0; p < uPasses; p++) {
+            __m128i vShift = _mm_cvtsi32_si128(2 + p * RADIX_BITS);
+            __m256i vDigits = _mm256_and_si256(_mm256_srl_epi64(vKeys, vShift), vMask);
+            _mm256_store_si256((__m256i *)arrDigits, vDigits);
+
+            arrHist[p][arrDigits[0]]++;
+            arrHist[p][arrDigits[1]]++;
+            arrHist[p][arrDigits[2]]++;
+            arrHist[p][arrDigits[3]]++;
+        }
+    }
+
+    HistogramScalar(pKeys + i, uCount - i, uPasses, arrHist);
+}
+
+/*
+ * Cells whose first access is a read, over keys sorted by cell: a key starts a run when its cell differs
+ * from the one before it.
+ */
+static uint64_t CountFirstReadsScalar(const uint64_t *pKeys, size_t uBegin, size_t uCount) {
+
+    uint64_t uRMS = 0;
+    for (size_t i = uBegin; i < uCount; i++) {
+        bool bStart = i == 0 || (pKeys[i] >> 2) != (pKeys[i - 1] >> 2);
+        uRMS += bStart & (pKeys[i] & DISTINCT_READ);
+    }
+    return uRMS;
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t CountFirstReadsAVX2(const uint64_t *pKeys, size_t uCount) {
+
+    if (uCount == 0) {
+        return 0;
+    }
+
+    uint64_t uRMS = pKeys[0] & DISTINCT_READ;
+
+    size_t i = 1;
+    for (; i + 4 <= uCount; i += 4) {
+        __m256i vKeys = _mm256_loadu_si256((const __m256i *)(pKeys + i));
+        __m256i vPrev = _mm256_loadu_si256((const __m256i *)(pKeys + i - 1));
+
+        __m256i vSame = _mm256_cmpeq_epi64(_mm256_srli_epi64(vKeys, 2), _mm256_srli_epi64(vPrev, 2));
+        unsigned uStarts = ~(unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(vSame)) & 0xF;
+        unsigned uReads = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(vKeys, 63)));
+
+        uRMS += _mm_popcnt_u32(uStarts & uReads);
+    }
+
+    return uRMS + CountFirstReadsScalar(pKeys, i, uCount);
+}
+
+/*
+ * Runs with at least one write, without a branch per key.
+ */
+static uint64_t CountWrittenRuns(const uint64_t *pKeys, size_t uCount) {
+
+    uint64_t uWritten = 0;
+    uint64_t uSeen = 0;
+
+    for (size_t i = 0; i < uCount; i++) {
+        uint64_t uStart = i == 0 || (pKeys[i] >> 2) != (pKeys[i - 1] >> 2);
+        uint64_t uWrite = (pKeys[i] & DISTINCT_WRITE) >> 1;
+
+        uSeen &= uStart ^ 1;
+        uWritten += uWrite & (uSeen ^ 1);
+        uSeen |= uWrite;
+    }
+
+    return uWritten;
+}
+
+DistinctCounter::DistinctCounter() {
+    bAVX2 = __builtin_cpu_supports("avx2");
+}
+
+void DistinctCounter::Count(vector<uint64_t> &vecKeys, uint64_t &uRMS, uint64_t &uDistinctWrites) {
+
+    if (vecKeys.size() < SORT_THRESHOLD) {
+        CountHashed(vecKeys, uRMS, uDistinctWrites);
+    } else {
+        CountSorted(vecKeys, uRMS, uDistinctWrites);
+    }
+}
+
+void DistinctCounter::CountHashed(vector<uint64_t> &vecKeys, uint64_t &uRMS, uint64_t &uDistinctWrites) {
+
+    setSeen.Clear();
+    setWritten.Clear();
+
+    uRMS = 0;
+    uDistinctWrites = 0;
+
+    for (size_t i = 0; i < vecKeys.size(); i++) {
+        uint64_t uCell = vecKeys[i] >> 2;
+
+        if (setSeen.Insert(uCell) && (vecKeys[i] & DISTINCT_READ)) {
+            uRMS++;
+        }
+        if ((vecKeys[i] & DISTINCT_WRITE) && setWritten.Insert(uCell)) {
+            uDistinctWrites++;
+        }
+    }
+}
+
+void DistinctCounter::CountSorted(vector<uint64_t> &vecKeys, uint64_t &uRMS, uint64_t &uDistinctWrites) {
+
+    size_t uCount = vecKeys.size();
+
+    // only the digits the cells reach
+    uint64_t uAll = 0;
+    for (size_t i = 0; i < uCount; i++) {
+        uAll |= vecKeys[i];
+    }
+    unsigned uPasses = 0;
+    while (uPasses < MAX_PASSES && (uAll >> (2 + uPasses * RADIX_BITS)) != 0) {
+        uPasses++;
+    }
+
+    uint64_t arrHist[MAX_PASSES][RADIX_SIZE];
+    memset(arrHist, 0, sizeof(arrHist));
+
+    if (bAVX2) {
+        HistogramAVX2(&vecKeys[0], uCount, uPasses, arrHist);
+    } else {
+        HistogramScalar(&vecKeys[0], uCount, uPasses, arrHist);
+    }
+
+    vecBuffer.resize(uCount);
+    uint64_t *pFrom = &vecKeys[0];
+    uint64_t *pTo = &vecBuffer[0];
+
+    for (unsigned p = 0; p < uPasses; p++) {
+        unsigned uShift = 2 + p * RADIX_BITS;
+
+        // a digit shared by every key would move nothing
+        if (arrHist[p][(pFrom[0] >> uShift) & (RADIX_SIZE - 1)] == uCount) {
+            continue;
+        }
+
+        uint64_t arrOffset[RADIX_SIZE];
+        uint64_t uSum = 0;
+        for (unsigned d = 0; d < RADIX_SIZE; d++) {
+            arrOffset[d] = uSum;
+            uSum += arrHist[p][d];
+        }
+
+        for (size_t i = 0; i < uCount; i++) {
+            pTo[arrOffset[(pFrom[i] >> uShift) & (RADIX_SIZE - 1)]++] = pFrom[i];
+        }
+
+        swap(pFrom, pTo);
+    }
+
+    uRMS = bAVX2 ? CountFirstReadsAVX2(pFrom, uCount) : CountFirstReadsScalar(pFrom, 0, uCount);
+    uDistinctWrites = CountWrittenRuns(pFrom, uCount);
+}
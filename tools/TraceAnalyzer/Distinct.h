@@ -0,0 +1,66 @@
+#ifndef COMAIR_TRACEANALYZER_DISTINCT_H
+#define COMAIR_TRACEANALYZER_DISTINCT_H
+
+#include <stdint.h>
+
+#include <vector>
+
+using namespace std;
+
+/*
+ * Accesses are keyed as cell << 2 | kind: bit 0 for a read, bit 1 for a write, both for a read-modify-write.
+ */
+#define DISTINCT_READ 1ULL
+#define DISTINCT_WRITE 2ULL
+#define DISTINCT_KEY(cell, kind) (((uint64_t)(cell) << 2) | (kind))
+
+/*
+ * Open addressing set of memory cells, cleared between invocations in time proportional to what it held.
+ */
+class CellSet {
+
+public:
+
+    CellSet();
+
+    // true if the cell was not in the set
+    bool Insert(uint64_t uCell);
+
+    void Clear();
+
+private:
+
+    void Grow();
+
+    vector<uint64_t> vecKeys;
+    uint64_t uSize;
+};
+
+/*
+ * RMS (cells first accessed by a read) and distinct written cells of the accesses of one invocation.
+ * Small invocations go through hash sets. Large ones are sorted with a stable LSD radix sort on the cell,
+ * which keeps the accesses of a cell in program order, and counted in one pass over the runs.
+ * Digit extraction and the run scan use AVX2 when the CPU has it.
+ */
+class DistinctCounter {
+
+public:
+
+    DistinctCounter();
+
+    // vecKeys in program order, reordered by the call
+    void Count(vector<uint64_t> &vecKeys, uint64_t &uRMS, uint64_t &uDistinctWrites);
+
+private:
+
+    void CountHashed(vector<uint64_t> &vecKeys, uint64_t &uRMS, uint64_t &uDistinctWrites);
+
+    void CountSorted(vector<uint64_t> &vecKeys, uint64_t &uRMS, uint64_t &uDistinctWrites);
+
+    CellSet setSeen;
+    CellSet setWritten;
+    vector<uint64_t> vecBuffer;
+    bool bAVX2;
+};
+
+#endif //COMAIR_TRACEANALYZER_DISTINCT_H
@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <queue>
+
+#include "External.h"
+
+using namespace std;
+
+static bool CompareCell(uint64_t uLeft, uint64_t uRight) {
+    return (uLeft >> 2) < (uRight >> 2);
+}
+
+/*
+ * The next key of each run, the smallest cell on top and the earlier run on ties.
+ */
+struct stRunHead {
+    uint64_t uKey;
+    size_t uRun;
+
+    bool operator<(const stRunHead &Other) const {
+        if ((uKey >> 2) != (Other.uKey >> 2)) {
+            return (uKey >> 2) > (Other.uKey >> 2);
+        }
+        return uRun > Other.uRun;
+    }
+};
+
+FILE *CreateRun(const string &sTempDir) {
+
+    string sTemplate = sTempDir + "/newcomair_run_XXXXXX";
+    vector<char> vecPath(sTemplate.begin(), sTemplate.end());
+    vecPath.push_back('\0');
+
+    int fd = mkstemp(&vecPath[0]);
+    FILE *pFile = fd == -1 ? NULL : fdopen(fd, "w+b");
+
+    if (pFile == NULL) {
+        if (fd != -1) {
+            close(fd);
+        }
+        fprintf(stderr, "cannot create a run in %s\n", sTempDir.c_str());
+        return NULL;
+    }
+
+    // the file goes away with its descriptor, even if the analyzer is killed
+    unlink(&vecPath[0]);
+
+    return pFile;
+}
+
+ExternalCounter::ExternalCounter(size_t uBudgetBytes, const string &sTempDir)
+        : uBudgetBytes(uBudgetBytes), sTempDir(sTempDir), bFailed(false) {
+
+    // the chunk and the scratch of its sort
+    uChunkKeys = max((size_t)MIN_READ_KEYS, uBudgetBytes / (2 * sizeof(uint64_t)));
+}
+
+ExternalCounter::~ExternalCounter() {
+    Reset();
+}
+
+void ExternalCounter::Reset() {
+
+    for (size_t i = 0; i < vecRuns.size(); i++) {
+        fclose(vecRuns[i]);
+    }
+    vecRuns.clear();
+    vecChunk.clear();
+    bFailed = false;
+}
+
+void ExternalCounter::Spill() {
+
+    if (vecChunk.empty()) {
+        return;
+    }
+
+    stable_sort(vecChunk.begin(), vecChunk.end(), CompareCell);
+
+    FILE *pFile = CreateRun(sTempDir);
+    if (pFile == NULL) {
+        bFailed = true;
+        vecChunk.clear();
+        return;
+    }
+
+    if (fwrite(&vecChunk[0], sizeof(uint64_t), vecChunk.size(), pFile) != vecChunk.size() || fflush(pFile) != 0) {
+        fprintf(stderr, "cannot write a run in %s\n", sTempDir.c_str());
+        bFailed = true;
+    }
+
+    vecRuns.push_back(pFile);
+    vecChunk.clear();
+}
+
+bool ExternalCounter::Finish(uint64_t &uRMS, uint64_t &uDistinctWrites) {
+
+    uRMS = 0;
+    uDistinctWrites = 0;
+
+    if (vecRuns.empty() && !bFailed) {
+        Counter.Count(vecChunk, uRMS, uDistinctWrites);
+        vecChunk.clear();
+        return true;
+    }
+
+    Spill();
+
+    bool bMerged = !bFailed && Merge(uRMS, uDistinctWrites);
+    Reset();
+
+    // the chunk is released, the next stream starts small
+    vector<uint64_t>().swap(vecChunk);
+
+    return bMerged;
+}
+
+bool ExternalCounter::Merge(uint64_t &uRMS, uint64_t &uDistinctWrites) {
+
+    size_t uBufferKeys = max((size_t)MIN_READ_KEYS, uBudgetBytes / sizeof(uint64_t) / (vecRuns.size() + 1));
+
+    // the chunk is not needed while merging
+    vector<uint64_t>().swap(vecChunk);
+
+    vector<RunReader<uint64_t> *> vecReaders;
+    priority_queue<stRunHead> queueHeads;
+
+    for (size_t i = 0; i < vecRuns.size(); i++) {
+        vecReaders.push_back(new RunReader<uint64_t>(vecRuns[i], uBufferKeys));
+
+        stRunHead Head;
+        Head.uRun = i;
+        if (vecReaders[i]->Next(Head.uKey)) {
+            queueHeads.push(Head);
+        }
+    }
+
+    bool bFirst = true;
+    uint64_t uCell = 0;
+    bool bWritten = false;
+
+    while (!queueHeads.empty()) {
+        stRunHead Head = queueHeads.top();
+        queueHeads.pop();
+
+        if (bFirst || (Head.uKey >> 2) != uCell) {
+            bFirst = false;
+            uCell = Head.uKey >> 2;
+            bWritten = false;
+            uRMS += (Head.uKey & DISTINCT_READ) != 0;
+        }
+
+        if ((Head.uKey & DISTINCT_WRITE) && !bWritten) {
+            bWritten = true;
+            uDistinctWrites++;
+        }
+
+        if (vecReaders[Head.uRun]->Next(Head.uKey)) {
+            queueHeads.push(Head);
+        }
+    }
+
+    bool bOK = true;
+    for (size_t i = 0; i < vecReaders.size(); i++) {
+        bOK = bOK && !vecReaders[i]->Failed();
+        delete vecReaders[i];
+    }
+
+    return bOK;
+}
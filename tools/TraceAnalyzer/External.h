@@ -0,0 +1,250 @@
+#ifndef COMAIR_TRACEANALYZER_EXTERNAL_H
+#define COMAIR_TRACEANALYZER_EXTERNAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "Distinct.h"
+
+using namespace std;
+
+// a run is read back through a buffer of at least this many items
+#define MIN_READ_KEYS 512
+
+// an unlinked temporary file in sTempDir, NULL with a message when it cannot be created
+FILE *CreateRun(const string &sTempDir);
+
+/*
+ * Buffered reader of a run of items.
+ */
+template<typename T>
+class RunReader {
+
+public:
+
+    RunReader(FILE *pFile, size_t uBufferItems) : pFile(pFile), uNext(0), uCount(0), bFailed(false) {
+        vecBuffer.resize(uBufferItems);
+        rewind(pFile);
+    }
+
+    bool Next(T &Item) {
+        if (uNext == uCount) {
+            uCount = fread(&vecBuffer[0], sizeof(T), vecBuffer.size(), pFile);
+            uNext = 0;
+            if (uCount == 0) {
+                bFailed = ferror(pFile) != 0;
+                return false;
+            }
+        }
+        Item = vecBuffer[uNext++];
+        return true;
+    }
+
+    bool Failed() const { return bFailed; }
+
+private:
+
+    FILE *pFile;
+    vector<T> vecBuffer;
+    size_t uNext;
+    size_t uCount;
+    bool bFailed;
+};
+
+/*
+ * Sort of a stream of items in bounded memory, the way ExternalCounter spills its keys: the chunk is stably
+ * sorted and spilled as a run when full, and Sort merges the runs k ways, earlier runs first on ties, so
+ * equal items come out in the order they were added. A stream that fits is sorted in memory.
+ */
+template<typename T, typename Less>
+class ExternalSorter {
+
+public:
+
+    ExternalSorter(size_t uBudgetBytes, const string &sTempDir, Less Compare = Less())
+            : uBudgetBytes(uBudgetBytes), sTempDir(sTempDir), Compare(Compare), uNext(0), bFailed(false) {
+        // the chunk and the scratch of its sort
+        uChunkItems = max((size_t)MIN_READ_KEYS, uBudgetBytes / (2 * sizeof(T)));
+    }
+
+    ~ExternalSorter() {
+        for (size_t i = 0; i < vecReaders.size(); i++) {
+            delete vecReaders[i];
+        }
+        for (size_t i = 0; i < vecRuns.size(); i++) {
+            fclose(vecRuns[i]);
+        }
+    }
+
+    void Add(const T &Item) {
+        vecChunk.push_back(Item);
+        if (vecChunk.size() >= uChunkItems) {
+            Spill();
+        }
+    }
+
+    // ends the stream, false when a run could not be written
+    bool Sort() {
+        if (vecRuns.empty() && !bFailed) {
+            stable_sort(vecChunk.begin(), vecChunk.end(), Compare);
+            return true;
+        }
+
+        Spill();
+        vector<T>().swap(vecChunk);
+
+        size_t uBufferItems = max((size_t)MIN_READ_KEYS, uBudgetBytes / sizeof(T) / (vecRuns.size() + 1));
+        for (size_t i = 0; i < vecRuns.size(); i++) {
+            vecReaders.push_back(new RunReader<T>(vecRuns[i], uBufferItems));
+
+            stHead Head;
+            Head.uRun = i;
+            if (vecReaders[i]->Next(Head.Item)) {
+                queueHeads.push(Head);
+            }
+        }
+
+        return !bFailed;
+    }
+
+    // the items in order after Sort, false at the end
+    bool Next(T &Item) {
+        if (vecReaders.empty()) {
+            if (uNext == vecChunk.size()) {
+                return false;
+            }
+            Item = vecChunk[uNext++];
+            return true;
+        }
+
+        if (queueHeads.empty()) {
+            return false;
+        }
+
+        stHead Head = queueHeads.top();
+        queueHeads.pop();
+        Item = Head.Item;
+
+        if (vecReaders[Head.uRun]->Next(Head.Item)) {
+            queueHeads.push(Head);
+        }
+        return true;
+    }
+
+    // a run could not be written or read back
+    bool Failed() const {
+        bool bRunFailed = bFailed;
+        for (size_t i = 0; i < vecReaders.size(); i++) {
+            bRunFailed = bRunFailed || vecReaders[i]->Failed();
+        }
+        return bRunFailed;
+    }
+
+private:
+
+    // the next item of each run
+    struct stHead {
+        T Item;
+        size_t uRun;
+    };
+
+    // the smallest item on top, the earlier run on ties
+    struct stHeadOrder {
+        Less Compare;
+
+        bool operator()(const stHead &Left, const stHead &Right) const {
+            if (Compare(Right.Item, Left.Item)) {
+                return true;
+            }
+            if (Compare(Left.Item, Right.Item)) {
+                return false;
+            }
+            return Left.uRun > Right.uRun;
+        }
+    };
+
+    void Spill() {
+        if (vecChunk.empty()) {
+            return;
+        }
+
+        stable_sort(vecChunk.begin(), vecChunk.end(), Compare);
+
+        FILE *pFile = CreateRun(sTempDir);
+        if (pFile == NULL) {
+            bFailed = true;
+            vecChunk.clear();
+            return;
+        }
+
+        if (fwrite(&vecChunk[0], sizeof(T), vecChunk.size(), pFile) != vecChunk.size() || fflush(pFile) != 0) {
+            fprintf(stderr, "cannot write a run in %s\n", sTempDir.c_str());
+            bFailed = true;
+        }
+
+        vecRuns.push_back(pFile);
+        vecChunk.clear();
+    }
+
+    size_t uBudgetBytes;
+    size_t uChunkItems;
+    string sTempDir;
+    Less Compare;
+    vector<T> vecChunk;
+    size_t uNext;
+    vector<FILE *> vecRuns;
+    vector<RunReader<T> *> vecReaders;
+    priority_queue<stHead, vector<stHead>, stHeadOrder> queueHeads{stHeadOrder{Compare}};
+    bool bFailed;
+};
+
+/*
+ * Distinct counting in bounded memory, for key streams larger than RAM. Keys (see Distinct.h) are buffered
+ * up to the budget; a full buffer is stably sorted by cell and spilled as a run to an unlinked temporary
+ * file. Finish merges the runs k ways, earlier runs first on equal cells, so every cell still sees its
+ * accesses in program order. A stream that fits is counted in memory by DistinctCounter.
+ */
+class ExternalCounter {
+
+public:
+
+    ExternalCounter(size_t uBudgetBytes, const string &sTempDir);
+
+    ~ExternalCounter();
+
+    // keys in program order
+    void Add(uint64_t uKey) {
+        vecChunk.push_back(uKey);
+        if (vecChunk.size() >= uChunkKeys) {
+            Spill();
+        }
+    }
+
+    // false when a run could not be written or read back
+    bool Finish(uint64_t &uRMS, uint64_t &uDistinctWrites);
+
+    size_t GetRunCount() const { return vecRuns.size(); }
+
+private:
+
+    void Spill();
+
+    bool Merge(uint64_t &uRMS, uint64_t &uDistinctWrites);
+
+    void Reset();
+
+    size_t uBudgetBytes;
+    size_t uChunkKeys;
+    string sTempDir;
+    vector<uint64_t> vecChunk;
+    vector<FILE *> vecRuns;
+    bool bFailed;
+    DistinctCounter Counter;
+};
+
+#endif //COMAIR_TRACEANALYZER_EXTERNAL_H
@@ -0,0 +1,175 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "Fit.h"
+
+using namespace std;
+
+#define HUBER_K 1.345
+#define MAX_ITERATIONS 50
+
+static const char *g_ModelNames[MODEL_COUNT] = {"constant", "log", "linear", "nlogn", "quadratic", "cubic"};
+
+const char *GetModelName(int iModel) {
+    return g_ModelNames[iModel];
+}
+
+static double GetBasis(int iModel, double fSize) {
+
+    switch (iModel) {
+        case MODEL_LOG:
+            return log(fSize);
+        case MODEL_LINEAR:
+            return fSize;
+        case MODEL_NLOGN:
+            return fSize * log(fSize);
+        case MODEL_QUADRATIC:
+            return fSize * fSize;
+        case MODEL_CUBIC:
+            return fSize * fSize * fSize;
+        default:
+            return 0;
+    }
+}
+
+static double GetMedian(vector<double> &vecValues) {
+
+    size_t uMiddle = vecValues.size() / 2;
+    nth_element(vecValues.begin(), vecValues.begin() + uMiddle, vecValues.end());
+    double fMedian = vecValues[uMiddle];
+
+    if (vecValues.size() % 2 == 0) {
+        fMedian = (fMedian + *max_element(vecValues.begin(), vecValues.begin() + uMiddle)) / 2;
+    }
+    return fMedian;
+}
+
+/*
+ * Weighted least squares of y = a + b * x, b left at 0 when x does not vary.
+ */
+static void SolveWeighted(const vector<double> &vecX, const vector<double> &vecY, const vector<double> &vecWeights,
+                          double &fIntercept, double &fCoefficient) {
+
+    double fWeights = 0;
+    double fMeanX = 0;
+    double fMeanY = 0;
+    for (size_t i = 0; i < vecX.size(); i++) {
+        fWeights += vecWeights[i];
+        fMeanX += vecWeights[i] * vecX[i];
+        fMeanY += vecWeights[i] * vecY[i];
+    }
+    fMeanX /= fWeights;
+    fMeanY /= fWeights;
+
+    double fCovariance = 0;
+    double fVariance = 0;
+    for (size_t i = 0; i < vecX.size(); i++) {
+        fCovariance += vecWeights[i] * (vecX[i] - fMeanX) * (vecY[i] - fMeanY);
+        fVariance += vecWeights[i] * (vecX[i] - fMeanX) * (vecX[i] - fMeanX);
+    }
+
+    fCoefficient = fVariance > 0 ? fCovariance / fVariance : 0;
+    fIntercept = fMeanY - fCoefficient * fMeanX;
+}
+
+stFit FitModel(int iModel, const vector<double> &vecSizes, const vector<double> &vecValues) {
+
+    size_t uPoints = vecSizes.size();
+    vector<double> vecX(uPoints);
+    vector<double> vecWeights(uPoints, 1.0);
+    vector<double> vecResiduals(uPoints);
+
+    for (size_t i = 0; i < uPoints; i++) {
+        vecX[i] = GetBasis(iModel, vecSizes[i]);
+    }
+
+    stFit Fit = {0, 0, 0};
+    SolveWeighted(vecX, vecValues, vecWeights, Fit.fIntercept, Fit.fCoefficient);
+
+    for (int iIteration = 0; iIteration < MAX_ITERATIONS; iIteration++) {
+
+        vector<double> vecDeviations(uPoints);
+        double fMeanDeviation = 0;
+        for (size_t i = 0; i < uPoints; i++) {
+            vecResiduals[i] = vecValues[i] - Fit.fIntercept - Fit.fCoefficient * vecX[i];
+            vecDeviations[i] = fabs(vecResiduals[i]);
+            fMeanDeviation += vecDeviations[i] / uPoints;
+        }
+
+        // most points fitted exactly leave no median deviation, the mean one still scales the outliers
+        double fScale = GetMedian(vecDeviations) / 0.6745;
+        if (fScale <= 0) {
+            fScale = fMeanDeviation / 0.7979;
+        }
+        if (fScale <= 0) {
+            break;
+        }
+
+        for (size_t i = 0; i < uPoints; i++) {
+            double fResidual = fabs(vecResiduals[i]) / fScale;
+            vecWeights[i] = fResidual <= HUBER_K ? 1.0 : HUBER_K / fResidual;
+        }
+
+        double fIntercept;
+        double fCoefficient;
+        SolveWeighted(vecX, vecValues, vecWeights, fIntercept, fCoefficient);
+
+        bool bConverged = fabs(fIntercept - Fit.fIntercept) <= 1e-9 * fabs(fIntercept) &&
+                          fabs(fCoefficient - Fit.fCoefficient) <= 1e-9 * fabs(fCoefficient);
+        Fit.fIntercept = fIntercept;
+        Fit.fCoefficient = fCoefficient;
+        if (bConverged) {
+            break;
+        }
+    }
+
+    double fWeights = 0;
+    double fMean = 0;
+    for (size_t i = 0; i < uPoints; i++) {
+        fWeights += vecWeights[i];
+        fMean += vecWeights[i] * vecValues[i];
+    }
+    fMean /= fWeights;
+
+    double fResidual = 0;
+    double fTotal = 0;
+    for (size_t i = 0; i < uPoints; i++) {
+        double fError = vecValues[i] - Fit.fIntercept - Fit.fCoefficient * vecX[i];
+        fResidual += vecWeights[i] * fError * fError;
+        fTotal += vecWeights[i] * (vecValues[i] - fMean) * (vecValues[i] - fMean);
+    }
+
+    // a flat series is explained by any model that reproduces it
+    if (fTotal > 0) {
+        Fit.fR2 = 1 - fResidual / fTotal;
+    } else {
+        Fit.fR2 = fResidual > 0 ? 0 : 1;
+    }
+
+    return Fit;
+}
+
+int FitComplexity(const vector<double> &vecSizes, const vector<double> &vecValues, vector<stFit> &vecFits) {
+
+    vecFits.clear();
+
+    vector<double> vecDistinct(vecSizes);
+    sort(vecDistinct.begin(), vecDistinct.end());
+    if (unique(vecDistinct.begin(), vecDistinct.end()) - vecDistinct.begin() < 3) {
+        return -1;
+    }
+
+    int iBest = MODEL_CONSTANT;
+
+    for (int iModel = 0; iModel < MODEL_COUNT; iModel++) {
+        vecFits.push_back(FitModel(iModel, vecSizes, vecValues));
+
+        if (iModel != MODEL_CONSTANT && vecFits[iModel].fCoefficient > 0 &&
+            1 - vecFits[iModel].fR2 < 0.5 * (1 - vecFits[iBest].fR2)) {
+            iBest = iModel;
+        }
+    }
+
+    return iBest;
+}
@@ -0,0 +1,45 @@
+#ifndef COMAIR_TRACEANALYZER_FIT_H
+#define COMAIR_TRACEANALYZER_FIT_H
+
+#include <vector>
+
+using namespace std;
+
+/*
+ * Growth models of a cost against the input size n, each fitted as y = a + b * g(n).
+ */
+enum {
+    MODEL_CONSTANT = 0,     // g(n) = 0
+    MODEL_LOG,              // log n
+    MODEL_LINEAR,           // n
+    MODEL_NLOGN,            // n log n
+    MODEL_QUADRATIC,        // n^2
+    MODEL_CUBIC,            // n^3
+    MODEL_COUNT
+};
+
+const char *GetModelName(int iModel);
+
+struct stFit {
+    double fIntercept;
+    double fCoefficient;
+    // 1 - weighted residual / weighted total sum of squares, with the final weights of the fit
+    double fR2;
+};
+
+/*
+ * Huber M-estimate of one model by iteratively reweighted least squares: residuals beyond 1.345 times
+ * their scale (median absolute deviation) are down-weighted, so a few outlying invocations do not bend
+ * the curve. Sizes must be at least 1.
+ */
+stFit FitModel(int iModel, const vector<double> &vecSizes, const vector<double> &vecValues);
+
+/*
+ * All the models, fitted in vecFits, and the index of the one explaining the data: models are taken
+ * in order of growth, and a faster-growing one replaces the current choice only when it halves the
+ * unexplained variance. A model with a negative coefficient is never chosen.
+ * -1 when there are fewer than three distinct sizes.
+ */
+int FitComplexity(const vector<double> &vecSizes, const vector<double> &vecValues, vector<stFit> &vecFits);
+
+#endif //COMAIR_TRACEANALYZER_FIT_H
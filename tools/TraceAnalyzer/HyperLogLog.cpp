@@ -0,0 +1,82 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "HyperLogLog.h"
+
+using namespace std;
+
+#define MIN_PRECISION 4
+#define MAX_PRECISION 18
+
+uint64_t HashKey(uint64_t uKey) {
+    uKey ^= uKey >> 33;
+    uKey *= 0xFF51AFD7ED558CCDULL;
+    uKey ^= uKey >> 33;
+    uKey *= 0xC4CEB9FE1A85EC53ULL;
+    uKey ^= uKey >> 33;
+    return uKey;
+}
+
+HyperLogLog::HyperLogLog(unsigned uPrecision) {
+    this->uPrecision = min(max(uPrecision, (unsigned)MIN_PRECISION), (unsigned)MAX_PRECISION);
+    vecRegisters.assign(1UL << this->uPrecision, 0);
+}
+
+unsigned HyperLogLog::PrecisionForError(double dError) {
+
+    unsigned uPrecision = MIN_PRECISION;
+    while (uPrecision < MAX_PRECISION && 1.04 / sqrt((double)(1UL << uPrecision)) > dError) {
+        uPrecision++;
+    }
+    return uPrecision;
+}
+
+void HyperLogLog::Add(uint64_t uHash) {
+
+    // the top bits choose the register, the rank is the position of the first 1 in the rest
+    uint64_t uIndex = uHash >> (64 - uPrecision);
+    uint64_t uRest = (uHash << uPrecision) | (1ULL << (uPrecision - 1));
+    uint8_t uRank = (uint8_t)(__builtin_clzll(uRest) + 1);
+
+    if (vecRegisters[uIndex] < uRank) {
+        vecRegisters[uIndex] = uRank;
+    }
+}
+
+void HyperLogLog::Merge(const HyperLogLog &Other) {
+
+    if (Other.uPrecision != uPrecision) {
+        return;
+    }
+
+    for (size_t i = 0; i < vecRegisters.size(); i++) {
+        vecRegisters[i] = max(vecRegisters[i], Other.vecRegisters[i]);
+    }
+}
+
+double HyperLogLog::Estimate() const {
+
+    double dRegisters = (double)vecRegisters.size();
+    double dSum = 0;
+    size_t uZeros = 0;
+
+    for (size_t i = 0; i < vecRegisters.size(); i++) {
+        dSum += ldexp(1.0, -(int)vecRegisters[i]);
+        uZeros += vecRegisters[i] == 0;
+    }
+
+    double dAlpha = 0.7213 / (1 + 1.079 / dRegisters);
+    double dEstimate = dAlpha * dRegisters * dRegisters / dSum;
+
+    // linear counting while many registers are empty
+    if (dEstimate <= 2.5 * dRegisters && uZeros != 0) {
+        dEstimate = dRegisters * log(dRegisters / (double)uZeros);
+    }
+
+    return dEstimate;
+}
+
+void HyperLogLog::Clear() {
+    fill(vecRegisters.begin(), vecRegisters.end(), 0);
+}
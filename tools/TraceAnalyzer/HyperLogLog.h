@@ -0,0 +1,42 @@
+#ifndef COMAIR_TRACEANALYZER_HYPERLOGLOG_H
+#define COMAIR_TRACEANALYZER_HYPERLOGLOG_H
+
+#include <stdint.h>
+
+#include <vector>
+
+using namespace std;
+
+/*
+ * HyperLogLog sketch of a set of 64-bit hashes: 2^precision one-byte registers, a standard error of
+ * about 1.04 / sqrt(2^precision) whatever the size of the set. Sketches of the same precision merge
+ * into the sketch of the union.
+ */
+class HyperLogLog {
+
+public:
+
+    // 4 to 18
+    explicit HyperLogLog(unsigned uPrecision = 14);
+
+    // the smallest precision reaching a relative standard error
+    static unsigned PrecisionForError(double dError);
+
+    void Add(uint64_t uHash);
+
+    void Merge(const HyperLogLog &Other);
+
+    double Estimate() const;
+
+    void Clear();
+
+private:
+
+    unsigned uPrecision;
+    vector<uint8_t> vecRegisters;
+};
+
+// a 64-bit mix of a key, the input HyperLogLog expects
+uint64_t HashKey(uint64_t uKey);
+
+#endif //COMAIR_TRACEANALYZER_HYPERLOGLOG_H
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "Profile.h"
+
+using namespace std;
+
+/*
+ * Function symbols of an nm listing, "address type name", by address.
+ */
+static bool ReadSymbols(const string &sSymbols, map<uint64_t, string> &mapFunctions, string &sError) {
+
+    ifstream fSymbols(sSymbols.c_str());
+    if (!fSymbols.is_open()) {
+        sError = "cannot open the symbols " + sSymbols;
+        return false;
+    }
+
+    string sLine;
+    while (getline(fSymbols, sLine)) {
+        istringstream ssLine(sLine);
+        string sAddress;
+        string sType;
+        string sName;
+
+        if (!(ssLine >> sAddress >> sType >> sName)) {
+            continue;
+        }
+
+        if (sType != "T" && sType != "t" && sType != "W" && sType != "w") {
+            continue;
+        }
+
+        mapFunctions[strtoull(sAddress.c_str(), NULL, 16)] = sName;
+    }
+
+    return true;
+}
+
+bool WriteIndirectProfile(const TraceReader &Reader, const string &sSymbols, const string &sProfile,
+                          string &sError) {
+
+    map<uint64_t, string> mapFunctions;
+    if (!ReadSymbols(sSymbols, mapFunctions, sError)) {
+        return false;
+    }
+
+    uint64_t uAnchor = 0;
+    for (map<uint64_t, string>::iterator itFunction = mapFunctions.begin(); itFunction != mapFunctions.end();
+         itFunction++) {
+        if (itFunction->second == "main") {
+            uAnchor = itFunction->first;
+        }
+    }
+
+    if (uAnchor == 0) {
+        fprintf(stderr, "no main in %s, the targets are taken as raw addresses\n", sSymbols.c_str());
+    }
+
+    // ins_id -> target -> count
+    map<unsigned, map<uint64_t, uint64_t> > mapSites;
+    for (const stMemRecord *pRecord = Reader.begin(); pRecord != Reader.end(); pRecord++) {
+        if (RECORD_KIND(pRecord->flag) == RECORD_INDIRECT_TARGET) {
+            mapSites[pRecord->length][uAnchor + pRecord->address]++;
+        }
+    }
+
+    FILE *pProfile = fopen(sProfile.c_str(), "w");
+    if (pProfile == NULL) {
+        sError = "cannot write the profile " + sProfile;
+        return false;
+    }
+
+    for (map<unsigned, map<uint64_t, uint64_t> >::iterator itSite = mapSites.begin(); itSite != mapSites.end();
+         itSite++) {
+        for (map<uint64_t, uint64_t>::iterator itTarget = itSite->second.begin(); itTarget != itSite->second.end();
+             itTarget++) {
+
+            map<uint64_t, string>::iterator itFunction = mapFunctions.find(itTarget->first);
+            if (itFunction == mapFunctions.end()) {
+                fprintf(stderr, "no function at 0x%lx, target of %u\n", (unsigned long)itTarget->first,
+                        itSite->first);
+                continue;
+            }
+
+            fprintf(pProfile, "%u %s %lu\n", itSite->first, itFunction->second.c_str(),
+                    (unsigned long)itTarget->second);
+        }
+    }
+
+    if (fclose(pProfile) != 0) {
+        sError = "cannot write the profile " + sProfile;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef COMAIR_TRACEANALYZER_PROFILE_H
+#define COMAIR_TRACEANALYZER_PROFILE_H
+
+#include <string>
+
+#include "TraceReader/TraceReader.h"
+
+using namespace std;
+
+/*
+ * The indirect call profile read by -indirectProfile, from the target records of a -bCounterOnly run:
+ * one "ins_id name count" line per call site and target. Targets are named from the symbols of the
+ * instrumented binary, as listed by nm, the records being relative to main.
+ * Targets no symbol starts at are reported on stderr and left out.
+ */
+bool WriteIndirectProfile(const TraceReader &Reader, const string &sSymbols, const string &sProfile,
+                          string &sError);
+
+#endif //COMAIR_TRACEANALYZER_PROFILE_H
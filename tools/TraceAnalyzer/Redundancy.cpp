@@ -0,0 +1,357 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "Redundancy.h"
+
+using namespace std;
+
+// sites reported per loop
+#define MAX_REPORTED_SITES 5
+
+#define OBJECT_BIT (1ULL << 63)
+#define OBJECT_SHIFT 40
+#define OBJECT_ID_MASK ((1ULL << (63 - OBJECT_SHIFT)) - 1)
+#define OBJECT_OFFSET_MASK ((1ULL << OBJECT_SHIFT) - 1)
+
+ObjectMap::ObjectMap() : uNextID(0), uFreedID(0) {
+}
+
+void ObjectMap::Update(const stMemRecord &Record) {
+
+    switch (RECORD_KIND(Record.flag)) {
+        case RECORD_ALLOC: {
+            stObject Object = {Record.length, uNextID++};
+            mapObjects[Record.address] = Object;
+            break;
+        }
+        case RECORD_FREE: {
+            map<uint64_t, stObject>::iterator itObject = mapObjects.find(Record.address);
+            if (itObject != mapObjects.end()) {
+                uFreedID = itObject->second.uID;
+                mapObjects.erase(itObject);
+            } else {
+                // allocated before the sampled invocation, a move makes it a new object
+                uFreedID = uNextID++;
+            }
+            break;
+        }
+        case RECORD_REALLOC: {
+            // the free record of the old base came just before
+            stObject Object = {Record.length, uFreedID};
+            mapObjects[Record.address] = Object;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+uint64_t ObjectMap::Translate(uint64_t uAddress) const {
+
+    map<uint64_t, stObject>::const_iterator itObject = mapObjects.upper_bound(uAddress);
+    if (itObject == mapObjects.begin()) {
+        return uAddress;
+    }
+
+    itObject--;
+    uint64_t uOffset = uAddress - itObject->first;
+    if (uOffset >= itObject->second.uSize) {
+        return uAddress;
+    }
+
+    return OBJECT_BIT | ((itObject->second.uID & OBJECT_ID_MASK) << OBJECT_SHIFT) | (uOffset & OBJECT_OFFSET_MASK);
+}
+
+void ReadSet::Add(uint64_t uBegin, uint64_t uEnd, long lSite) {
+    stInterval Interval = {uBegin, uEnd, lSite};
+    vecSites.push_back(Interval);
+}
+
+static bool CompareBegin(const ReadSet::stInterval &Left, const ReadSet::stInterval &Right) {
+    return Left.uBegin < Right.uBegin;
+}
+
+/*
+ * Sorted intervals, merged when they overlap or touch. bSameSite keeps the sites apart.
+ */
+static void MergeSorted(vector<ReadSet::stInterval> &vecIntervals, bool bSameSite) {
+
+    size_t uKept = 0;
+
+    for (size_t i = 0; i < vecIntervals.size(); i++) {
+        if (uKept != 0) {
+            ReadSet::stInterval &Last = vecIntervals[uKept - 1];
+            if ((!bSameSite || Last.lSite == vecIntervals[i].lSite) && vecIntervals[i].uBegin <= Last.uEnd) {
+                Last.uEnd = max(Last.uEnd, vecIntervals[i].uEnd);
+                continue;
+            }
+        }
+        vecIntervals[uKept++] = vecIntervals[i];
+    }
+
+    vecIntervals.resize(uKept);
+}
+
+void ReadSet::Normalize() {
+
+    sort(vecSites.begin(), vecSites.end());
+    MergeSorted(vecSites, true);
+
+    vecUnion = vecSites;
+    sort(vecUnion.begin(), vecUnion.end(), CompareBegin);
+    MergeSorted(vecUnion, false);
+}
+
+void ReadSet::Clear() {
+    vecSites.clear();
+    vecUnion.clear();
+}
+
+uint64_t ReadSet::GetBytes() const {
+
+    uint64_t uBytes = 0;
+    for (size_t i = 0; i < vecUnion.size(); i++) {
+        uBytes += vecUnion[i].uEnd - vecUnion[i].uBegin;
+    }
+    return uBytes;
+}
+
+uint64_t ReadSet::Intersect(const stInterval *pFirst, const stInterval *pLast, const vector<stInterval> &vecOther) {
+
+    if (pFirst == pLast) {
+        return 0;
+    }
+
+    // the first interval of vecOther ending after pFirst begins
+    size_t j = 0;
+    size_t uCount = vecOther.size();
+    while (uCount > 0) {
+        size_t uHalf = uCount / 2;
+        if (vecOther[j + uHalf].uEnd <= pFirst->uBegin) {
+            j += uHalf + 1;
+            uCount -= uHalf + 1;
+        } else {
+            uCount = uHalf;
+        }
+    }
+
+    uint64_t uBytes = 0;
+
+    while (pFirst != pLast && j < vecOther.size()) {
+        uint64_t uBegin = max(pFirst->uBegin, vecOther[j].uBegin);
+        uint64_t uEnd = min(pFirst->uEnd, vecOther[j].uEnd);
+        if (uBegin < uEnd) {
+            uBytes += uEnd - uBegin;
+        }
+
+        if (pFirst->uEnd < vecOther[j].uEnd) {
+            pFirst++;
+        } else {
+            j++;
+        }
+    }
+
+    return uBytes;
+}
+
+uint64_t ReadSet::Overlap(const ReadSet &Previous, map<long, uint64_t> &mapSites) const {
+
+    const stInterval *pIntervals = vecSites.data();
+
+    for (size_t i = 0; i < vecSites.size();) {
+        size_t uNext = i;
+        while (uNext < vecSites.size() && vecSites[uNext].lSite == vecSites[i].lSite) {
+            uNext++;
+        }
+
+        uint64_t uBytes = Intersect(pIntervals + i, pIntervals + uNext, Previous.vecUnion);
+        if (uBytes != 0) {
+            mapSites[vecSites[i].lSite] += uBytes;
+        }
+        i = uNext;
+    }
+
+    return Intersect(vecUnion.data(), vecUnion.data() + vecUnion.size(), Previous.vecUnion);
+}
+
+// the invocation being read
+struct stCurrent {
+    uint64_t uSequence;
+    int64_t lLoopID;
+    int64_t lInputSize;
+    int64_t lTripCount;
+    ReadSet Reads;
+};
+
+struct stLoopState {
+    bool bSeen;
+    uint64_t uPrevious;
+    ReadSet Previous;
+
+    uint64_t uPairs;
+    double fRatioSum;
+    vector<double> vecLogSize;
+    vector<double> vecLogOverlap;
+    vector<double> vecLogRatio;
+    map<long, uint64_t> mapSites;
+
+    stLoopState() : bSeen(false), uPrevious(0), uPairs(0), fRatioSum(0) {}
+};
+
+static double FitSlope(const vector<double> &vecX, const vector<double> &vecY) {
+
+    double fMeanX = 0;
+    double fMeanY = 0;
+    for (size_t i = 0; i < vecX.size(); i++) {
+        fMeanX += vecX[i];
+        fMeanY += vecY[i];
+    }
+    fMeanX /= vecX.size();
+    fMeanY /= vecX.size();
+
+    double fCovariance = 0;
+    double fVariance = 0;
+    for (size_t i = 0; i < vecX.size(); i++) {
+        fCovariance += (vecX[i] - fMeanX) * (vecY[i] - fMeanY);
+        fVariance += (vecX[i] - fMeanX) * (vecX[i] - fMeanX);
+    }
+
+    return fCovariance / fVariance;
+}
+
+static void FinishInvocation(stCurrent &Current, map<int64_t, stLoopState> &mapLoops, vector<stOverlap> &vecPairs) {
+
+    Current.Reads.Normalize();
+    stLoopState &Loop = mapLoops[Current.lLoopID];
+
+    if (Loop.bSeen) {
+        stOverlap Pair;
+        Pair.uSequence = Current.uSequence;
+        Pair.uPrevious = Loop.uPrevious;
+        Pair.lLoopID = Current.lLoopID;
+        Pair.uReadBytes = Current.Reads.GetBytes();
+        Pair.uOverlapBytes = Current.Reads.Overlap(Loop.Previous, Loop.mapSites);
+
+        if (Current.lInputSize >= 0) {
+            Pair.uInputSize = Current.lInputSize;
+        } else if (Current.lTripCount >= 0) {
+            Pair.uInputSize = Current.lTripCount;
+        } else {
+            Pair.uInputSize = Pair.uReadBytes;
+        }
+
+        vecPairs.push_back(Pair);
+
+        double fRatio = Pair.uReadBytes != 0 ? (double)Pair.uOverlapBytes / Pair.uReadBytes : 0;
+        Loop.uPairs++;
+        Loop.fRatioSum += fRatio;
+
+        if (Pair.uOverlapBytes != 0 && Pair.uInputSize != 0) {
+            Loop.vecLogSize.push_back(log((double)Pair.uInputSize));
+            Loop.vecLogOverlap.push_back(log((double)Pair.uOverlapBytes));
+            Loop.vecLogRatio.push_back(log(fRatio));
+        }
+    }
+
+    Loop.bSeen = true;
+    Loop.uPrevious = Current.uSequence;
+    swap(Loop.Previous, Current.Reads);
+    Current.Reads.Clear();
+}
+
+static bool CompareSiteBytes(const pair<long, uint64_t> &Left, const pair<long, uint64_t> &Right) {
+    if (Left.second != Right.second) {
+        return Left.second > Right.second;
+    }
+    return Left.first < Right.first;
+}
+
+void DetectRedundancy(const TraceReader &Reader, vector<stOverlap> &vecPairs, vector<stLoopRedundancy> &vecLoops) {
+
+    ObjectMap Objects;
+    map<int64_t, stLoopState> mapLoops;
+    stCurrent Current;
+    bool bInvocation = false;
+    uint64_t uSequence = 0;
+
+    vecPairs.clear();
+    vecLoops.clear();
+
+    for (const stMemRecord *pRecord = Reader.begin(); pRecord != Reader.end(); pRecord++) {
+
+        switch (RECORD_KIND(pRecord->flag)) {
+            case RECORD_DELIMIT:
+                if (bInvocation) {
+                    FinishInvocation(Current, mapLoops, vecPairs);
+                }
+                bInvocation = true;
+                Current.uSequence = uSequence++;
+                Current.lLoopID = (int64_t)pRecord->address;
+                Current.lInputSize = -1;
+                Current.lTripCount = -1;
+                break;
+            case RECORD_ALLOC:
+            case RECORD_FREE:
+            case RECORD_REALLOC:
+                Objects.Update(*pRecord);
+                break;
+            case RECORD_INPUT_SIZE:
+                if (Current.lInputSize < 0) {
+                    Current.lInputSize = (int64_t)pRecord->address;
+                }
+                break;
+            case RECORD_TRIP_COUNT:
+                Current.lTripCount = (int64_t)pRecord->address;
+                break;
+            case RECORD_LOAD:
+            case RECORD_SHARED_LOAD:
+            case RECORD_SHARED_RMW: {
+                if (!bInvocation) {
+                    break;
+                }
+                uint64_t uBytes = (pRecord->length + 7) / 8;
+                if (uBytes == 0) {
+                    uBytes = 1;
+                }
+                // the upper bits of the shared accesses are a thread, not a site
+                long lSite = RECORD_KIND(pRecord->flag) == RECORD_LOAD ? RECORD_SITE(pRecord->flag) : -1;
+                uint64_t uBegin = Objects.Translate(pRecord->address);
+                Current.Reads.Add(uBegin, uBegin + uBytes, lSite);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    if (bInvocation) {
+        FinishInvocation(Current, mapLoops, vecPairs);
+    }
+
+    for (map<int64_t, stLoopState>::iterator itLoop = mapLoops.begin(); itLoop != mapLoops.end(); itLoop++) {
+        stLoopState &Loop = itLoop->second;
+        if (Loop.uPairs == 0) {
+            continue;
+        }
+
+        stLoopRedundancy Summary;
+        Summary.lLoopID = itLoop->first;
+        Summary.uPairs = Loop.uPairs;
+        Summary.fMeanRatio = Loop.fRatioSum / Loop.uPairs;
+
+        Summary.bFitted = !Loop.vecLogSize.empty() &&
+                          *min_element(Loop.vecLogSize.begin(), Loop.vecLogSize.end()) !=
+                          *max_element(Loop.vecLogSize.begin(), Loop.vecLogSize.end());
+        Summary.fOverlapSlope = Summary.bFitted ? FitSlope(Loop.vecLogSize, Loop.vecLogOverlap) : 0;
+        Summary.fRatioSlope = Summary.bFitted ? FitSlope(Loop.vecLogSize, Loop.vecLogRatio) : 0;
+
+        Summary.vecSites.assign(Loop.mapSites.begin(), Loop.mapSites.end());
+        sort(Summary.vecSites.begin(), Summary.vecSites.end(), CompareSiteBytes);
+        if (Summary.vecSites.size() > MAX_REPORTED_SITES) {
+            Summary.vecSites.resize(MAX_REPORTED_SITES);
+        }
+
+        vecLoops.push_back(Summary);
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef COMAIR_TRACEANALYZER_REDUNDANCY_H
+#define COMAIR_TRACEANALYZER_REDUNDANCY_H
+
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include "TraceReader/TraceReader.h"
+
+using namespace std;
+
+/*
+ * Heap objects of the trace, from its alloc, free and realloc records. An address inside a live object is
+ * translated to the object ID and the offset in it, so a buffer moved by realloc keeps its addresses.
+ * Only the allocations made inside sampled invocations of a -bAlloc trace are recorded: a buffer moved between
+ * two invocations keeps its raw addresses, and its data read again is not reported.
+ */
+class ObjectMap {
+
+public:
+
+    ObjectMap();
+
+    // alloc, free and realloc records change the map, the others are ignored
+    void Update(const stMemRecord &Record);
+
+    // 1 << 63 | id << 40 | offset inside an object, the address itself otherwise
+    uint64_t Translate(uint64_t uAddress) const;
+
+private:
+
+    struct stObject {
+        uint64_t uSize;
+        uint64_t uID;
+    };
+
+    map<uint64_t, stObject> mapObjects;
+    uint64_t uNextID;
+    uint64_t uFreedID;
+};
+
+/*
+ * Bytes read by one invocation, as intervals. Normalize merges them into their union, and per site.
+ */
+class ReadSet {
+
+public:
+
+    // bytes [uBegin, uEnd) read by a site
+    struct stInterval {
+        uint64_t uBegin;
+        uint64_t uEnd;
+        long lSite;
+
+        bool operator<(const stInterval &Other) const {
+            if (lSite != Other.lSite) {
+                return lSite < Other.lSite;
+            }
+            return uBegin < Other.uBegin;
+        }
+    };
+
+    // [uBegin, uEnd), lSite the ins_id of the load or -1
+    void Add(uint64_t uBegin, uint64_t uEnd, long lSite);
+
+    void Normalize();
+
+    void Clear();
+
+    uint64_t GetBytes() const;
+
+    // bytes also read by Previous, in all and per site of this set
+    uint64_t Overlap(const ReadSet &Previous, map<long, uint64_t> &mapSites) const;
+
+private:
+
+    // bytes of [pFirst, pLast), sorted and disjoint, inside the intervals of vecOther
+    static uint64_t Intersect(const stInterval *pFirst, const stInterval *pLast, const vector<stInterval> &vecOther);
+
+    // sorted by site then begin, disjoint within a site once normalized
+    vector<stInterval> vecSites;
+    // the union of the sites, sorted and disjoint
+    vector<stInterval> vecUnion;
+};
+
+// an invocation against the previous sampled invocation of the same loop
+struct stOverlap {
+    uint64_t uSequence;
+    uint64_t uPrevious;
+    int64_t lLoopID;
+    uint64_t uInputSize;
+    uint64_t uReadBytes;
+    uint64_t uOverlapBytes;
+};
+
+struct stLoopRedundancy {
+    int64_t lLoopID;
+    uint64_t uPairs;
+    double fMeanRatio;
+    // least squares slopes of log(overlap bytes) and log(overlap ratio) over log(input size),
+    // valid when two input sizes differ
+    bool bFitted;
+    double fOverlapSlope;
+    double fRatioSlope;
+    // ins_id and bytes read again, most bytes first
+    vector<pair<long, uint64_t> > vecSites;
+};
+
+/*
+ * Reads the whole trace in order and compares the bytes read by each invocation with those read by the
+ * previous invocation of the same loop. A loop reading the same data over and over (a search restarted on
+ * a growing buffer) has overlap ratios near 1 and overlap growing with its input.
+ * The input size of an invocation is its first input size record, else its trip count, else its bytes read.
+ */
+void DetectRedundancy(const TraceReader &Reader, vector<stOverlap> &vecPairs, vector<stLoopRedundancy> &vecLoops);
+
+#endif //COMAIR_TRACEANALYZER_REDUNDANCY_H
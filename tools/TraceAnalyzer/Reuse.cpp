@@ -0,0 +1,346 @@
+#include <algorithm>
+
+#include "Reuse.h"
+
+using namespace std;
+
+static size_t GetBucket(uint64_t uDistance) {
+    return uDistance == 0 ? 0 : 64 - __builtin_clzll(uDistance);
+}
+
+void stReuseSummary::Add(const stReuse &Reuse) {
+
+    uInvocations++;
+    uAccesses += Reuse.uAccesses;
+    uCold += Reuse.uCold;
+
+    if (vecHistogram.size() < Reuse.vecHistogram.size()) {
+        vecHistogram.resize(Reuse.vecHistogram.size(), 0);
+    }
+    for (size_t i = 0; i < Reuse.vecHistogram.size(); i++) {
+        vecHistogram[i] += Reuse.vecHistogram[i];
+    }
+
+    if (vecWindows.size() < Reuse.vecWorkingSet.size()) {
+        vecWindows.resize(Reuse.vecWorkingSet.size(), 0);
+        vecWindowCells.resize(Reuse.vecWorkingSet.size(), 0);
+    }
+    for (size_t i = 0; i < Reuse.vecWorkingSet.size(); i++) {
+        double fWindows = (double)(Reuse.uAccesses - (1ULL << i) + 1);
+        vecWindows[i] += fWindows;
+        vecWindowCells[i] += fWindows * Reuse.vecWorkingSet[i];
+    }
+}
+
+void stReuseSummary::Merge(const stReuseSummary &Other) {
+
+    uInvocations += Other.uInvocations;
+    uAccesses += Other.uAccesses;
+    uCold += Other.uCold;
+
+    if (vecHistogram.size() < Other.vecHistogram.size()) {
+        vecHistogram.resize(Other.vecHistogram.size(), 0);
+    }
+    for (size_t i = 0; i < Other.vecHistogram.size(); i++) {
+        vecHistogram[i] += Other.vecHistogram[i];
+    }
+
+    if (vecWindows.size() < Other.vecWindows.size()) {
+        vecWindows.resize(Other.vecWindows.size(), 0);
+        vecWindowCells.resize(Other.vecWindows.size(), 0);
+    }
+    for (size_t i = 0; i < Other.vecWindows.size(); i++) {
+        vecWindows[i] += Other.vecWindows[i];
+        vecWindowCells[i] += Other.vecWindowCells[i];
+    }
+}
+
+double stReuseSummary::GetWorkingSet(size_t uLevel) const {
+    return vecWindows[uLevel] > 0 ? vecWindowCells[uLevel] / vecWindows[uLevel] : 0;
+}
+
+double stReuseSummary::GetMissRatio(uint64_t uCells) const {
+
+    if (uAccesses == 0) {
+        return 0;
+    }
+
+    // distances of at least uCells are in the buckets above the one of uCells - 1
+    uint64_t uMisses = uCold;
+    for (size_t i = GetBucket(uCells - 1) + 1; i < vecHistogram.size(); i++) {
+        uMisses += vecHistogram[i];
+    }
+    return (double)uMisses / uAccesses;
+}
+
+void ReuseAnalyzer::Analyze(const vector<uint64_t> &vecCells, stReuse &Result) {
+
+    uint64_t uAccesses = vecCells.size();
+
+    Result.uAccesses = uAccesses;
+    Result.uCold = 0;
+    Result.vecHistogram.clear();
+    Result.vecWorkingSet.clear();
+
+    // times are 1-based, as Fenwick indexes
+    vecTree.assign(uAccesses + 1, 0);
+    vecReuseTimes.assign(uAccesses + 1, 0);
+    mapCells.clear();
+
+    for (uint64_t uTime = 1; uTime <= uAccesses; uTime++) {
+
+        pair<unordered_map<uint64_t, stCellTimes>::iterator, bool> Inserted =
+                mapCells.insert(make_pair(vecCells[uTime - 1], stCellTimes()));
+        stCellTimes &Times = Inserted.first->second;
+
+        if (Inserted.second) {
+            Times.uFirst = uTime;
+            Result.uCold++;
+        } else {
+            // marks in (uLast, uTime): the cells accessed since
+            uint64_t uDistance = 0;
+            for (uint64_t i = uTime - 1; i > 0; i -= i & (~i + 1)) {
+                uDistance += vecTree[i];
+            }
+            for (uint64_t i = Times.uLast; i > 0; i -= i & (~i + 1)) {
+                uDistance -= vecTree[i];
+            }
+
+            size_t uBucket = GetBucket(uDistance);
+            if (Result.vecHistogram.size() <= uBucket) {
+                Result.vecHistogram.resize(uBucket + 1, 0);
+            }
+            Result.vecHistogram[uBucket]++;
+            vecReuseTimes[uTime - Times.uLast]++;
+
+            for (uint64_t i = Times.uLast; i <= uAccesses; i += i & (~i + 1)) {
+                vecTree[i]--;
+            }
+        }
+
+        for (uint64_t i = uTime; i <= uAccesses; i += i & (~i + 1)) {
+            vecTree[i]++;
+        }
+        Times.uLast = uTime;
+    }
+
+    ComputeWorkingSets(uAccesses, Result);
+}
+
+/*
+ * Of the n - w + 1 windows of length w, a cell is missing from (f - w)+ before its first access at f,
+ * (n + 1 - l - w)+ after its last access at l, and (t - w)+ between two accesses t apart.
+ */
+void ReuseAnalyzer::ComputeWorkingSets(uint64_t uAccesses, stReuse &Result) {
+
+    double fCells = (double)mapCells.size();
+
+    for (uint64_t uWindow = 1; uWindow <= uAccesses; uWindow <<= 1) {
+
+        double fMissing = 0;
+        for (unordered_map<uint64_t, stCellTimes>::iterator itCell = mapCells.begin();
+             itCell != mapCells.end(); itCell++) {
+            uint64_t uBefore = itCell->second.uFirst;
+            uint64_t uAfter = uAccesses + 1 - itCell->second.uLast;
+            fMissing += uBefore > uWindow ? (double)(uBefore - uWindow) : 0;
+            fMissing += uAfter > uWindow ? (double)(uAfter - uWindow) : 0;
+        }
+
+        for (uint64_t uTime = uWindow + 1; uTime < uAccesses; uTime++) {
+            fMissing += (double)(uTime - uWindow) * vecReuseTimes[uTime];
+        }
+
+        Result.vecWorkingSet.push_back(fCells - fMissing / (double)(uAccesses - uWindow + 1));
+    }
+}
+
+// the cell, its Fenwick slot, its reuse time and its hash map node in ReuseAnalyzer, at most
+#define MEMORY_BYTES_PER_CELL 64
+
+ExternalReuseAnalyzer::ExternalReuseAnalyzer(size_t uBudgetBytes, const string &sTempDir)
+        : uBudgetBytes(uBudgetBytes), sTempDir(sTempDir), uAccesses(0), pCellTimes(NULL) {
+}
+
+ExternalReuseAnalyzer::~ExternalReuseAnalyzer() {
+    delete pCellTimes;
+}
+
+void ExternalReuseAnalyzer::Add(uint64_t uCell) {
+
+    uAccesses++;
+
+    if (pCellTimes != NULL) {
+        stCellTime CellTime = {uCell, uAccesses};
+        pCellTimes->Add(CellTime);
+        return;
+    }
+
+    vecCells.push_back(uCell);
+
+    if (uBudgetBytes != 0 && vecCells.size() * MEMORY_BYTES_PER_CELL > uBudgetBytes) {
+        // half for the runs of the cells, half for the runs of the pairs they make
+        pCellTimes = new ExternalSorter<stCellTime, stCellOrder>(uBudgetBytes / 2, sTempDir);
+        for (size_t i = 0; i < vecCells.size(); i++) {
+            stCellTime CellTime = {vecCells[i], i + 1};
+            pCellTimes->Add(CellTime);
+        }
+        vector<uint64_t>().swap(vecCells);
+    }
+}
+
+bool ExternalReuseAnalyzer::Finish(stReuse &Result) {
+
+    bool bOK = true;
+
+    if (pCellTimes == NULL) {
+        Analyzer.Analyze(vecCells, Result);
+        vecCells.clear();
+    } else {
+        bOK = AnalyzeRuns(Result);
+        delete pCellTimes;
+        pCellTimes = NULL;
+    }
+
+    uAccesses = 0;
+    return bOK;
+}
+
+/*
+ * Adds to the missing cells of every window length w below uTimes, the uTimes - w windows of the gap.
+ */
+void ExternalReuseAnalyzer::AddMissing(uint64_t uTimes, vector<double> &vecMissing) {
+
+    uint64_t uWindow = 1;
+    for (size_t i = 0; i < vecMissing.size() && uTimes > uWindow; i++, uWindow <<= 1) {
+        vecMissing[i] += (double)(uTimes - uWindow);
+    }
+}
+
+bool ExternalReuseAnalyzer::AnalyzeRuns(stReuse &Result) {
+
+    Result.uAccesses = uAccesses;
+    Result.uCold = 0;
+    Result.vecHistogram.clear();
+    Result.vecWorkingSet.clear();
+
+    // the missing cells of ReuseAnalyzer::ComputeWorkingSets, gathered per window length as the cells go by
+    vector<double> vecMissing;
+    for (uint64_t uWindow = 1; uWindow <= uAccesses; uWindow <<= 1) {
+        vecMissing.push_back(0);
+    }
+
+    // the times of each cell in order give its reuse pairs, which are sorted by time
+    ExternalSorter<stReusePair, stTimeOrder> Pairs(uBudgetBytes / 2, sTempDir);
+
+    if (!pCellTimes->Sort()) {
+        return false;
+    }
+
+    stCellTime CellTime;
+    bool bFirst = true;
+    stCellTime Last = {0, 0};
+
+    while (pCellTimes->Next(CellTime)) {
+        if (bFirst || CellTime.uCell != Last.uCell) {
+            if (!bFirst) {
+                AddMissing(uAccesses + 1 - Last.uTime, vecMissing);
+            }
+            bFirst = false;
+            Result.uCold++;
+            AddMissing(CellTime.uTime, vecMissing);
+        } else {
+            AddMissing(CellTime.uTime - Last.uTime, vecMissing);
+            stReusePair Pair = {Last.uTime, CellTime.uTime, 0};
+            Pairs.Add(Pair);
+        }
+        Last = CellTime;
+    }
+    if (!bFirst) {
+        AddMissing(uAccesses + 1 - Last.uTime, vecMissing);
+    }
+
+    if (pCellTimes->Failed()) {
+        return false;
+    }
+    delete pCellTimes;
+    pCellTimes = NULL;
+
+    // a block and its Fenwick tree take a quarter of the budget
+    uint64_t uBlock = max((uint64_t)MIN_READ_KEYS, (uint64_t)(uBudgetBytes / (4 * sizeof(uint64_t))));
+    stBlockOrder BlockOrder = {uBlock};
+    ExternalSorter<stReusePair, stBlockOrder> Blocks(uBudgetBytes / 2, sTempDir, BlockOrder);
+
+    // in time order, the pairs ending before t are in the tree, by the block they start in
+    vector<uint64_t> vecBlockTree(uAccesses / uBlock + 2, 0);
+    uint64_t uPairs = 0;
+
+    if (!Pairs.Sort()) {
+        return false;
+    }
+
+    stReusePair Pair;
+    while (Pairs.Next(Pair)) {
+        uint64_t uIndex = Pair.uPrevious / uBlock + 1;
+
+        uint64_t uUpTo = 0;
+        for (uint64_t i = uIndex; i > 0; i -= i & (~i + 1)) {
+            uUpTo += vecBlockTree[i];
+        }
+        Pair.uNested = uPairs - uUpTo;
+
+        for (uint64_t i = uIndex; i < vecBlockTree.size(); i += i & (~i + 1)) {
+            vecBlockTree[i]++;
+        }
+        uPairs++;
+
+        Blocks.Add(Pair);
+    }
+
+    if (Pairs.Failed() || !Blocks.Sort()) {
+        return false;
+    }
+
+    // block by block, in time order, the pairs of the block ending before t are in the tree, by their start
+    vector<uint64_t> vecTree;
+    uint64_t uCurrent = 0;
+    uint64_t uInBlock = 0;
+
+    while (Blocks.Next(Pair)) {
+        if (vecTree.empty() || Pair.uPrevious / uBlock != uCurrent) {
+            vecTree.assign(uBlock + 1, 0);
+            uCurrent = Pair.uPrevious / uBlock;
+            uInBlock = 0;
+        }
+
+        uint64_t uIndex = Pair.uPrevious % uBlock + 1;
+
+        uint64_t uUpTo = 0;
+        for (uint64_t i = uIndex; i > 0; i -= i & (~i + 1)) {
+            uUpTo += vecTree[i];
+        }
+        uint64_t uDistance = Pair.uTime - Pair.uPrevious - 1 - Pair.uNested - (uInBlock - uUpTo);
+
+        size_t uBucket = GetBucket(uDistance);
+        if (Result.vecHistogram.size() <= uBucket) {
+            Result.vecHistogram.resize(uBucket + 1, 0);
+        }
+        Result.vecHistogram[uBucket]++;
+
+        for (uint64_t i = uIndex; i <= uBlock; i += i & (~i + 1)) {
+            vecTree[i]++;
+        }
+        uInBlock++;
+    }
+
+    if (Blocks.Failed()) {
+        return false;
+    }
+
+    double fCells = (double)Result.uCold;
+    uint64_t uWindow = 1;
+    for (size_t i = 0; i < vecMissing.size(); i++, uWindow <<= 1) {
+        Result.vecWorkingSet.push_back(fCells - vecMissing[i] / (double)(uAccesses - uWindow + 1));
+    }
+
+    return true;
+}
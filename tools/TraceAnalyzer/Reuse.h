@@ -0,0 +1,152 @@
+#ifndef COMAIR_TRACEANALYZER_REUSE_H
+#define COMAIR_TRACEANALYZER_REUSE_H
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "External.h"
+
+using namespace std;
+
+/*
+ * Reuse distances are in distinct cells accessed since the previous access of the same cell, the LRU stack
+ * distance. Histogram bucket 0 holds distance 0, bucket k the distances in [2^(k-1), 2^k).
+ * The working set of window length 2^k is the mean number of distinct cells over all the windows of 2^k
+ * consecutive accesses.
+ */
+struct stReuse {
+    uint64_t uAccesses;
+    uint64_t uCold;
+    vector<uint64_t> vecHistogram;
+    vector<double> vecWorkingSet;
+};
+
+/*
+ * Reuse of the invocations of a loop, or of the whole trace. Working sets are weighted by the windows
+ * each invocation has, so the curve is the mean over all windows of all invocations.
+ */
+struct stReuseSummary {
+    uint64_t uInvocations;
+    uint64_t uAccesses;
+    uint64_t uCold;
+    vector<uint64_t> vecHistogram;
+    vector<double> vecWindowCells;
+    vector<double> vecWindows;
+
+    stReuseSummary() : uInvocations(0), uAccesses(0), uCold(0) {}
+
+    void Add(const stReuse &Reuse);
+
+    void Merge(const stReuseSummary &Other);
+
+    double GetWorkingSet(size_t uLevel) const;
+
+    // misses of a fully associative LRU cache of uCells cells, a power of 2, cold misses included
+    double GetMissRatio(uint64_t uCells) const;
+};
+
+/*
+ * Reuse distances in O(n log n): a Fenwick tree over the access times marks the last access of each cell,
+ * and the distance of an access is the count of marks after the previous access of its cell.
+ * The working sets follow from the reuse times and the first and last access of each cell in O(n) per
+ * window length (Xiang et al., all-window footprint).
+ */
+class ReuseAnalyzer {
+
+public:
+
+    // cells in access order
+    void Analyze(const vector<uint64_t> &vecCells, stReuse &Result);
+
+private:
+
+    struct stCellTimes {
+        uint64_t uFirst;
+        uint64_t uLast;
+    };
+
+    void ComputeWorkingSets(uint64_t uAccesses, stReuse &Result);
+
+    vector<uint32_t> vecTree;
+    // accesses per reuse time, the distance in accesses to the previous access of the cell
+    vector<uint64_t> vecReuseTimes;
+    unordered_map<uint64_t, stCellTimes> mapCells;
+};
+
+/*
+ * Reuse within a memory budget. An invocation whose cells fit is analyzed in memory by ReuseAnalyzer, a larger
+ * one from sorted runs on disk, with the same results. The distance of an access at t to its previous access
+ * at p is t - p - 1 less the reuse pairs (s, s') nested in (p, t), p < s < s' < t: every access in between
+ * is either the last of its cell before t or the start of such a pair. The times are cut into blocks that
+ * fit the budget. The pairs starting in a later block than p are counted in time order by a Fenwick tree over
+ * the blocks, those starting in the block of p by a Fenwick tree over the block, one block after the other.
+ */
+class ExternalReuseAnalyzer {
+
+public:
+
+    // no budget keeps every invocation in memory
+    ExternalReuseAnalyzer(size_t uBudgetBytes, const string &sTempDir);
+
+    ~ExternalReuseAnalyzer();
+
+    // cells in access order
+    void Add(uint64_t uCell);
+
+    // false when a run could not be written or read back
+    bool Finish(stReuse &Result);
+
+private:
+
+    struct stCellTime {
+        uint64_t uCell;
+        uint64_t uTime;
+    };
+
+    struct stCellOrder {
+        bool operator()(const stCellTime &Left, const stCellTime &Right) const {
+            return Left.uCell < Right.uCell;
+        }
+    };
+
+    // uNested counts the pairs starting in a later block than uPrevious
+    struct stReusePair {
+        uint64_t uPrevious;
+        uint64_t uTime;
+        uint64_t uNested;
+    };
+
+    struct stTimeOrder {
+        bool operator()(const stReusePair &Left, const stReusePair &Right) const {
+            return Left.uTime < Right.uTime;
+        }
+    };
+
+    struct stBlockOrder {
+        uint64_t uBlock;
+
+        bool operator()(const stReusePair &Left, const stReusePair &Right) const {
+            if (Left.uPrevious / uBlock != Right.uPrevious / uBlock) {
+                return Left.uPrevious / uBlock < Right.uPrevious / uBlock;
+            }
+            return Left.uTime < Right.uTime;
+        }
+    };
+
+    bool AnalyzeRuns(stReuse &Result);
+
+    void AddMissing(uint64_t uTimes, vector<double> &vecMissing);
+
+    size_t uBudgetBytes;
+    string sTempDir;
+    uint64_t uAccesses;
+    vector<uint64_t> vecCells;
+    // the cells and their times once over the budget, NULL before
+    ExternalSorter<stCellTime, stCellOrder> *pCellTimes;
+    ReuseAnalyzer Analyzer;
+};
+
+#endif //COMAIR_TRACEANALYZER_REUSE_H
@@ -0,0 +1,724 @@
+//
+// Trace analyzer: per sampled invocation accesses, RMS, distinct writes and cost of a newcomair trace.
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TraceReader/TraceReader.h"
+
+#include "Distinct.h"
+#include "External.h"
+#include "Fit.h"
+#include "HyperLogLog.h"
+#include "Profile.h"
+#include "Redundancy.h"
+#include "Reuse.h"
+
+using namespace std;
+
+// the shared memory written by InitMemHooks
+static const char *g_DefaultName = "newcomair_123456789";
+
+struct stInvocation {
+    uint64_t uSequence;
+    int64_t lLoopID;
+    uint64_t uAccesses;
+    uint64_t uRMS;
+    uint64_t uDistinctWrites;
+    uint64_t uCost;
+    int64_t lTripCount;
+    vector<uint64_t> vecInputSizes;
+};
+
+/*
+ * Approximate mode: sketches of the cells read and written, in place of the exact counts.
+ * RMS is then estimated as the distinct cells read, which counts a cell written before it is read too.
+ */
+struct stSketches {
+    HyperLogLog Reads;
+    HyperLogLog Writes;
+
+    explicit stSketches(unsigned uPrecision) : Reads(uPrecision), Writes(uPrecision) {}
+
+    void Clear() {
+        Reads.Clear();
+        Writes.Clear();
+    }
+
+    void Merge(const stSketches &Other) {
+        Reads.Merge(Other.Reads);
+        Writes.Merge(Other.Writes);
+    }
+};
+
+// all the invocations of one loop, approximate mode
+struct stLoopSummary {
+    uint64_t uInvocations;
+    uint64_t uAccesses;
+    stSketches Sketches;
+
+    explicit stLoopSummary(unsigned uPrecision) : uInvocations(0), uAccesses(0), Sketches(uPrecision) {}
+};
+
+// what a thread needs to count the cells of its invocations, in one of the three modes
+struct stThreadState {
+    DistinctCounter Counter;
+    vector<uint64_t> vecKeys;
+    stSketches *pSketches;
+    ExternalCounter *pExternal;
+};
+
+// the DISTINCT_READ and DISTINCT_WRITE bits of an access record, 0 for the other records. A callee argument
+// is no access, the callee may read any part of the object or none
+static uint64_t GetAccessKind(const stMemRecord &Record) {
+
+    switch (RECORD_KIND(Record.flag)) {
+        case RECORD_LOAD:
+        case RECORD_SHARED_LOAD:
+            return DISTINCT_READ;
+        case RECORD_STORE:
+        case RECORD_SHARED_STORE:
+            return DISTINCT_WRITE;
+        case RECORD_SHARED_RMW:
+            return DISTINCT_READ | DISTINCT_WRITE;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Accesses cover the cells [address / granularity, (address + length - 1) / granularity].
+ */
+static void GetCells(const stMemRecord &Record, uint64_t uGranularity, uint64_t &uFirst, uint64_t &uLast) {
+
+    uint64_t uBytes = (Record.length + 7) / 8;
+    if (uBytes == 0) {
+        uBytes = 1;
+    }
+    uFirst = Record.address / uGranularity;
+    uLast = (Record.address + uBytes - 1) / uGranularity;
+}
+
+/*
+ * A cell counts toward RMS when its first access in the invocation is a read.
+ */
+static void AnalyzeInvocation(const Invocation &Records, uint64_t uGranularity, stThreadState &State,
+                              stInvocation &Result) {
+
+    Result.uAccesses = 0;
+    Result.uRMS = 0;
+    Result.uDistinctWrites = 0;
+    Result.uCost = 0;
+    Result.lTripCount = -1;
+    Result.vecInputSizes.clear();
+
+    State.vecKeys.clear();
+    if (State.pSketches != NULL) {
+        State.pSketches->Clear();
+    }
+
+    for (const stMemRecord *pRecord = Records.begin(); pRecord != Records.end(); pRecord++) {
+
+        uint64_t uKind = GetAccessKind(*pRecord);
+
+        if (uKind == 0) {
+            switch (RECORD_KIND(pRecord->flag)) {
+                case RECORD_COST:
+                    Result.uCost += pRecord->address;
+                    break;
+                case RECORD_TRIP_COUNT:
+                    Result.lTripCount = (int64_t)pRecord->address;
+                    break;
+                case RECORD_INPUT_SIZE:
+                    if (Result.vecInputSizes.size() <= pRecord->length) {
+                        Result.vecInputSizes.resize(pRecord->length + 1, 0);
+                    }
+                    Result.vecInputSizes[pRecord->length] = pRecord->address;
+                    break;
+                default:
+                    break;
+            }
+            continue;
+        }
+
+        Result.uAccesses++;
+
+        uint64_t uFirst;
+        uint64_t uLast;
+        GetCells(*pRecord, uGranularity, uFirst, uLast);
+
+        if (State.pSketches != NULL) {
+            for (uint64_t uCell = uFirst; uCell <= uLast; uCell++) {
+                uint64_t uHash = HashKey(uCell);
+                if (uKind & DISTINCT_READ) {
+                    State.pSketches->Reads.Add(uHash);
+                }
+                if (uKind & DISTINCT_WRITE) {
+                    State.pSketches->Writes.Add(uHash);
+                }
+            }
+        } else if (State.pExternal != NULL) {
+            for (uint64_t uCell = uFirst; uCell <= uLast; uCell++) {
+                State.pExternal->Add(DISTINCT_KEY(uCell, uKind));
+            }
+        } else {
+            for (uint64_t uCell = uFirst; uCell <= uLast; uCell++) {
+                State.vecKeys.push_back(DISTINCT_KEY(uCell, uKind));
+            }
+        }
+    }
+
+    if (State.pSketches != NULL) {
+        Result.uRMS = (uint64_t)(State.pSketches->Reads.Estimate() + 0.5);
+        Result.uDistinctWrites = (uint64_t)(State.pSketches->Writes.Estimate() + 0.5);
+    } else if (State.pExternal != NULL) {
+        State.pExternal->Finish(Result.uRMS, Result.uDistinctWrites);
+    } else {
+        State.Counter.Count(State.vecKeys, Result.uRMS, Result.uDistinctWrites);
+    }
+}
+
+/*
+ * Invocations are handed out in small batches from a shared counter, so threads that drew short invocations
+ * take more of them. Work runs once per thread, with its number, and draws invocation indexes from Next
+ * until it returns false; state kept across the invocations of a thread lives in Work.
+ */
+static void ScheduleInvocations(size_t uInvocations, unsigned uThreads,
+                                const function<void(unsigned, const function<bool(size_t &)> &)> &Work) {
+
+    const size_t uBatch = 16;
+    atomic<size_t> uNext(0);
+    vector<thread> vecThreads;
+
+    for (unsigned t = 0; t < uThreads; t++) {
+        vecThreads.push_back(thread([&, t]() {
+            size_t uCurrent = 0;
+            size_t uLast = 0;
+
+            Work(t, [&](size_t &uIndex) {
+                if (uCurrent == uLast) {
+                    uCurrent = uNext.fetch_add(uBatch);
+                    if (uCurrent >= uInvocations) {
+                        uLast = uCurrent;
+                        return false;
+                    }
+                    uLast = min(uInvocations, uCurrent + uBatch);
+                }
+                uIndex = uCurrent++;
+                return true;
+            });
+        }));
+    }
+
+    for (unsigned t = 0; t < uThreads; t++) {
+        vecThreads[t].join();
+    }
+}
+
+/*
+ * RMS and distinct writes of the whole trace, one invocation after the other in trace order.
+ */
+static bool AnalyzeTrace(const TraceReader &Reader, vector<stIndexEntry> &vecIndex, uint64_t uGranularity,
+                         ExternalCounter &External, uint64_t &uAccesses, uint64_t &uRMS, uint64_t &uDistinctWrites) {
+
+    uAccesses = 0;
+
+    for (size_t i = 0; i < vecIndex.size(); i++) {
+        Invocation Records = Reader.GetInvocation(vecIndex[i]);
+
+        for (const stMemRecord *pRecord = Records.begin(); pRecord != Records.end(); pRecord++) {
+            uint64_t uKind = GetAccessKind(*pRecord);
+            if (uKind == 0) {
+                continue;
+            }
+
+            uAccesses++;
+
+            uint64_t uFirst;
+            uint64_t uLast;
+            GetCells(*pRecord, uGranularity, uFirst, uLast);
+
+            for (uint64_t uCell = uFirst; uCell <= uLast; uCell++) {
+                External.Add(DISTINCT_KEY(uCell, uKind));
+            }
+        }
+    }
+
+    return External.Finish(uRMS, uDistinctWrites);
+}
+
+/*
+ * Reuse distances and working sets of each invocation over its cells in access order, summarized per loop
+ * into mapLoops. With a memory budget, each thread analyzes in its share of it, an invocation over the share
+ * from runs spilled to sTempDir.
+ */
+static bool AnalyzeReuse(const TraceReader &Reader, vector<stIndexEntry> &vecIndex, uint64_t uGranularity,
+                         unsigned uThreads, size_t uBudgetBytes, const string &sTempDir, vector<stReuse> &vecReuse,
+                         map<int64_t, stReuseSummary> &mapLoops) {
+
+    vecReuse.resize(vecIndex.size());
+    vector<map<int64_t, stReuseSummary> > vecThreadLoops(uThreads);
+    atomic<bool> bOK(true);
+
+    ScheduleInvocations(vecIndex.size(), uThreads, [&](unsigned t, const function<bool(size_t &)> &Next) {
+        ExternalReuseAnalyzer Analyzer(uBudgetBytes / uThreads, sTempDir);
+
+        size_t i;
+        while (Next(i)) {
+            Invocation Records = Reader.GetInvocation(vecIndex[i]);
+
+            for (const stMemRecord *pRecord = Records.begin(); pRecord != Records.end(); pRecord++) {
+                if (GetAccessKind(*pRecord) == 0) {
+                    continue;
+                }
+
+                uint64_t uFirstCell;
+                uint64_t uLastCell;
+                GetCells(*pRecord, uGranularity, uFirstCell, uLastCell);
+                for (uint64_t uCell = uFirstCell; uCell <= uLastCell; uCell++) {
+                    Analyzer.Add(uCell);
+                }
+            }
+
+            if (!Analyzer.Finish(vecReuse[i])) {
+                bOK = false;
+            }
+            vecThreadLoops[t][vecIndex[i].lLoopID].Add(vecReuse[i]);
+        }
+    });
+
+    for (unsigned t = 0; t < uThreads; t++) {
+        map<int64_t, stReuseSummary> &mapThreadLoops = vecThreadLoops[t];
+        for (map<int64_t, stReuseSummary>::iterator itLoop = mapThreadLoops.begin();
+             itLoop != mapThreadLoops.end(); itLoop++) {
+            mapLoops[itLoop->first].Merge(itLoop->second);
+        }
+    }
+
+    return bOK;
+}
+
+static void PrintInvocation(const stInvocation &Result) {
+    printf("%lu\t%ld\t%lu\t%lu\t%lu\t%lu\t%ld\t", (unsigned long)Result.uSequence, (long)Result.lLoopID,
+           (unsigned long)Result.uAccesses,
+           (unsigned long)Result.uRMS, (unsigned long)Result.uDistinctWrites,
+           (unsigned long)Result.uCost, (long)Result.lTripCount);
+
+    for (size_t i = 0; i < Result.vecInputSizes.size(); i++) {
+        printf(i == 0 ? "%lu" : ",%lu", (unsigned long)Result.vecInputSizes[i]);
+    }
+    printf("\n");
+}
+
+static void PrintLoopSummaries(map<int64_t, stLoopSummary> &mapLoops) {
+
+    printf("\nloop_id\tinvocations\taccesses\tdistinct_reads\tdistinct_writes\n");
+
+    for (map<int64_t, stLoopSummary>::iterator itLoop = mapLoops.begin(); itLoop != mapLoops.end(); itLoop++) {
+        stLoopSummary &Summary = itLoop->second;
+        printf("%ld\t%lu\t%lu\t%.0f\t%.0f\n", (long)itLoop->first, (unsigned long)Summary.uInvocations,
+               (unsigned long)Summary.uAccesses, Summary.Sketches.Reads.Estimate(),
+               Summary.Sketches.Writes.Estimate());
+    }
+}
+
+/*
+ * Cost and RMS of the invocations of each loop against their input size: the first input size recorded,
+ * else the trip count. Invocations with neither, or a size of 0, are left out.
+ */
+static void PrintComplexity(vector<stInvocation> &vecInvocations) {
+
+    map<int64_t, vector<const stInvocation *> > mapLoops;
+    for (size_t i = 0; i < vecInvocations.size(); i++) {
+        mapLoops[vecInvocations[i].lLoopID].push_back(&vecInvocations[i]);
+    }
+
+    printf("\nloop_id\tmetric\tpoints\tmodel\tintercept\tcoefficient");
+    for (int iModel = 0; iModel < MODEL_COUNT; iModel++) {
+        printf("\tr2_%s", GetModelName(iModel));
+    }
+    printf("\n");
+
+    for (map<int64_t, vector<const stInvocation *> >::iterator itLoop = mapLoops.begin();
+         itLoop != mapLoops.end(); itLoop++) {
+
+        vector<double> vecSizes;
+        vector<double> vecCosts;
+        vector<double> vecRMS;
+
+        for (size_t i = 0; i < itLoop->second.size(); i++) {
+            const stInvocation *pResult = itLoop->second[i];
+            int64_t lSize = !pResult->vecInputSizes.empty() ? (int64_t)pResult->vecInputSizes[0] : pResult->lTripCount;
+            if (lSize <= 0) {
+                continue;
+            }
+            vecSizes.push_back((double)lSize);
+            vecCosts.push_back((double)pResult->uCost);
+            vecRMS.push_back((double)pResult->uRMS);
+        }
+
+        for (int iMetric = 0; iMetric < 2; iMetric++) {
+            vector<stFit> vecFits;
+            int iBest = FitComplexity(vecSizes, iMetric == 0 ? vecCosts : vecRMS, vecFits);
+
+            printf("%ld\t%s\t%lu\t", (long)itLoop->first, iMetric == 0 ? "cost" : "rms",
+                   (unsigned long)vecSizes.size());
+
+            if (iBest < 0) {
+                printf("-\t-\t-");
+                for (int iModel = 0; iModel < MODEL_COUNT; iModel++) {
+                    printf("\t-");
+                }
+                printf("\n");
+                continue;
+            }
+
+            printf("%s\t%g\t%g", GetModelName(iBest), vecFits[iBest].fIntercept, vecFits[iBest].fCoefficient);
+            for (int iModel = 0; iModel < MODEL_COUNT; iModel++) {
+                printf("\t%.4f", vecFits[iModel].fR2);
+            }
+            printf("\n");
+        }
+    }
+}
+
+static void PrintCounts(const vector<uint64_t> &vecCounts) {
+    for (size_t i = 0; i < vecCounts.size(); i++) {
+        printf(i == 0 ? "%lu" : ",%lu", (unsigned long)vecCounts[i]);
+    }
+}
+
+/*
+ * Histograms list the buckets from distance 0, working sets the window lengths from 1, doubling.
+ * Per loop and for all of them, the miss ratios of LRU caches of 512, 4096 and 32768 cells
+ * (32 KB, 256 KB and 2 MB with -g 64).
+ */
+static void PrintReuse(vector<stIndexEntry> &vecIndex, vector<stReuse> &vecReuse,
+                       map<int64_t, stReuseSummary> &mapLoops) {
+
+    printf("\ninvocation\tloop_id\taccesses\tcold\treuse_histogram\tworking_set\n");
+
+    for (size_t i = 0; i < vecReuse.size(); i++) {
+        printf("%lu\t%ld\t%lu\t%lu\t", (unsigned long)vecIndex[i].uSequence, (long)vecIndex[i].lLoopID,
+               (unsigned long)vecReuse[i].uAccesses, (unsigned long)vecReuse[i].uCold);
+        PrintCounts(vecReuse[i].vecHistogram);
+        printf("\t");
+        for (size_t j = 0; j < vecReuse[i].vecWorkingSet.size(); j++) {
+            printf(j == 0 ? "%.1f" : ",%.1f", vecReuse[i].vecWorkingSet[j]);
+        }
+        printf("\n");
+    }
+
+    printf("\nloop_id\tinvocations\taccesses\tcold\tmiss_512\tmiss_4096\tmiss_32768\treuse_histogram\tworking_set\n");
+
+    stReuseSummary All;
+    map<int64_t, stReuseSummary>::iterator itLoop = mapLoops.begin();
+
+    while (true) {
+        bool bAll = itLoop == mapLoops.end();
+        stReuseSummary &Summary = bAll ? All : itLoop->second;
+
+        if (bAll) {
+            printf("all\t");
+        } else {
+            printf("%ld\t", (long)itLoop->first);
+            All.Merge(Summary);
+        }
+
+        printf("%lu\t%lu\t%lu\t%.4f\t%.4f\t%.4f\t", (unsigned long)Summary.uInvocations,
+               (unsigned long)Summary.uAccesses, (unsigned long)Summary.uCold, Summary.GetMissRatio(512),
+               Summary.GetMissRatio(4096), Summary.GetMissRatio(32768));
+        PrintCounts(Summary.vecHistogram);
+        printf("\t");
+        for (size_t j = 0; j < Summary.vecWindows.size(); j++) {
+            printf(j == 0 ? "%.1f" : ",%.1f", Summary.GetWorkingSet(j));
+        }
+        printf("\n");
+
+        if (bAll) {
+            break;
+        }
+        itLoop++;
+    }
+}
+
+static void PrintRedundancy(vector<stOverlap> &vecPairs, vector<stLoopRedundancy> &vecLoops) {
+
+    printf("\nloop_id\tinvocation\tprevious\tinput_size\tread_bytes\toverlap_bytes\toverlap_ratio\n");
+
+    for (size_t i = 0; i < vecPairs.size(); i++) {
+        stOverlap &Pair = vecPairs[i];
+        printf("%ld\t%lu\t%lu\t%lu\t%lu\t%lu\t%.4f\n", (long)Pair.lLoopID, (unsigned long)Pair.uSequence,
+               (unsigned long)Pair.uPrevious, (unsigned long)Pair.uInputSize, (unsigned long)Pair.uReadBytes,
+               (unsigned long)Pair.uOverlapBytes,
+               Pair.uReadBytes != 0 ? (double)Pair.uOverlapBytes / Pair.uReadBytes : 0.0);
+    }
+
+    printf("\nloop_id\tpairs\tmean_ratio\toverlap_slope\tratio_slope\tsites\n");
+
+    for (size_t i = 0; i < vecLoops.size(); i++) {
+        stLoopRedundancy &Loop = vecLoops[i];
+        printf("%ld\t%lu\t%.4f\t", (long)Loop.lLoopID, (unsigned long)Loop.uPairs, Loop.fMeanRatio);
+
+        if (Loop.bFitted) {
+            printf("%.3f\t%.3f\t", Loop.fOverlapSlope, Loop.fRatioSlope);
+        } else {
+            printf("-\t-\t");
+        }
+
+        for (size_t j = 0; j < Loop.vecSites.size(); j++) {
+            printf(j == 0 ? "%ld:%lu" : ",%ld:%lu", Loop.vecSites[j].first, (unsigned long)Loop.vecSites[j].second);
+        }
+        printf("\n");
+    }
+}
+
+static void MergeLoopSummary(map<int64_t, stLoopSummary> &mapLoops, int64_t lLoopID, unsigned uPrecision,
+                             uint64_t uInvocations, uint64_t uAccesses, const stSketches &Sketches) {
+
+    map<int64_t, stLoopSummary>::iterator itLoop = mapLoops.find(lLoopID);
+    if (itLoop == mapLoops.end()) {
+        itLoop = mapLoops.insert(make_pair(lLoopID, stLoopSummary(uPrecision))).first;
+    }
+
+    itLoop->second.uInvocations += uInvocations;
+    itLoop->second.uAccesses += uAccesses;
+    itLoop->second.Sketches.Merge(Sketches);
+}
+
+/*
+ * Results land at their own index and are printed in trace order.
+ * With a precision, the counts are approximated by sketches, merged per loop into mapLoops.
+ * With a memory budget, each thread counts in its share of it, spilling to sTempDir.
+ */
+static void AnalyzeInvocations(const TraceReader &Reader, vector<stIndexEntry> &vecIndex, uint64_t uGranularity,
+                               unsigned uThreads, unsigned uPrecision, size_t uBudgetBytes, const string &sTempDir,
+                               vector<stInvocation> &vecInvocations, map<int64_t, stLoopSummary> &mapLoops) {
+
+    vecInvocations.resize(vecIndex.size());
+    vector<map<int64_t, stLoopSummary> > vecThreadLoops(uThreads);
+
+    ScheduleInvocations(vecIndex.size(), uThreads, [&](unsigned t, const function<bool(size_t &)> &Next) {
+        stSketches Sketches(uPrecision);
+        ExternalCounter External(uBudgetBytes / uThreads, sTempDir);
+
+        stThreadState State;
+        State.pSketches = uPrecision != 0 ? &Sketches : NULL;
+        State.pExternal = uBudgetBytes != 0 ? &External : NULL;
+
+        size_t i;
+        while (Next(i)) {
+            AnalyzeInvocation(Reader.GetInvocation(vecIndex[i]), uGranularity, State, vecInvocations[i]);
+            vecInvocations[i].uSequence = vecIndex[i].uSequence;
+            vecInvocations[i].lLoopID = vecIndex[i].lLoopID;
+
+            if (State.pSketches != NULL) {
+                MergeLoopSummary(vecThreadLoops[t], vecIndex[i].lLoopID, uPrecision, 1,
+                                 vecInvocations[i].uAccesses, Sketches);
+            }
+        }
+    });
+
+    for (unsigned t = 0; t < uThreads; t++) {
+        map<int64_t, stLoopSummary> &mapThreadLoops = vecThreadLoops[t];
+        for (map<int64_t, stLoopSummary>::iterator itLoop = mapThreadLoops.begin();
+             itLoop != mapThreadLoops.end(); itLoop++) {
+            MergeLoopSummary(mapLoops, itLoop->first, uPrecision, itLoop->second.uInvocations,
+                             itLoop->second.uAccesses, itLoop->second.Sketches);
+        }
+    }
+}
+
+static void PrintUsage(const char *pProgram) {
+    fprintf(stderr, "usage: %s [-f file | -s shm_name] [-g granularity] [-j threads] [-n invocation] [-a error]\n"
+                    "          [-m megabytes [-T dir]] [-r] [-c] [-u]\n"
+                    "          [-y symbols -p profile]\n", pProgram);
+    fprintf(stderr, "  -f file         read the trace from a file\n");
+    fprintf(stderr, "  -s shm_name     read the trace from a shared memory (default %s)\n", g_DefaultName);
+    fprintf(stderr, "  -g granularity  bytes per memory cell for RMS and distinct writes (default 1)\n");
+    fprintf(stderr, "  -j threads      analysis threads (default: one per core)\n");
+    fprintf(stderr, "  -n invocation   analyze only this invocation\n");
+    fprintf(stderr, "  -a error        approximate distinct counts in constant memory, with this relative error,\n");
+    fprintf(stderr, "                  and summarize each loop; rms is then the distinct cells read\n");
+    fprintf(stderr, "  -m megabytes    bound the scratch memory, spilling sorted runs to disk, and count\n");
+    fprintf(stderr, "                  the whole trace as well\n");
+    fprintf(stderr, "  -T dir          directory of the spilled runs (default $TMPDIR or /tmp)\n");
+    fprintf(stderr, "  -r              compare the bytes read by each invocation with the previous invocation\n");
+    fprintf(stderr, "                  of its loop, and report the overlap, its growth with the input size\n");
+    fprintf(stderr, "                  and the load sites (ins_id:bytes) reading the same data again\n");
+    fprintf(stderr, "  -c              fit the cost and rms of each loop against its input size with constant,\n");
+    fprintf(stderr, "                  log, linear, n log n, quadratic and cubic models\n");
+    fprintf(stderr, "  -u              reuse distance histograms and working set curves of each invocation,\n");
+    fprintf(stderr, "                  of each loop and of the trace, in cells of the granularity; within -m, from\n");
+    fprintf(stderr, "                  runs on disk for the invocations over the budget\n");
+    fprintf(stderr, "  -y symbols      nm listing of the instrumented binary, to name indirect call targets\n");
+    fprintf(stderr, "  -p profile      write the indirect call profile of a -bCounterOnly trace, for\n");
+    fprintf(stderr, "                  -indirectProfile, and stop\n");
+}
+
+int main(int argc, char **argv) {
+
+    string sShmName = g_DefaultName;
+    string sFile;
+    uint64_t uGranularity = 1;
+    unsigned uThreads = thread::hardware_concurrency();
+    long lOnly = -1;
+    unsigned uPrecision = 0;
+    size_t uBudgetBytes = 0;
+    string sTempDir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    bool bRedundancy = false;
+    bool bComplexity = false;
+    bool bReuse = false;
+    string sSymbols;
+    string sProfile;
+
+    int iOption;
+    while ((iOption = getopt(argc, argv, "f:s:g:j:n:a:m:T:rcuy:p:h")) != -1) {
+        switch (iOption) {
+            case 'f':
+                sFile = optarg;
+                break;
+            case 's':
+                sShmName = optarg;
+                break;
+            case 'g':
+                uGranularity = strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                uThreads = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                lOnly = strtol(optarg, NULL, 10);
+                break;
+            case 'a':
+                uPrecision = HyperLogLog::PrecisionForError(strtod(optarg, NULL));
+                break;
+            case 'm':
+                uBudgetBytes = strtoul(optarg, NULL, 10) << 20;
+                break;
+            case 'T':
+                sTempDir = optarg;
+                break;
+            case 'r':
+                bRedundancy = true;
+                break;
+            case 'c':
+                bComplexity = true;
+                break;
+            case 'u':
+                bReuse = true;
+                break;
+            case 'y':
+                sSymbols = optarg;
+                break;
+            case 'p':
+                sProfile = optarg;
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return iOption == 'h' ? 0 : 1;
+        }
+    }
+
+    if (uGranularity == 0 || sSymbols.empty() != sProfile.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    if (uThreads == 0) {
+        uThreads = 1;
+    }
+
+    TraceReader Reader;
+    bool bOpened = sFile.empty() ? Reader.OpenShm(sShmName) : Reader.OpenFile(sFile);
+    if (!bOpened) {
+        fprintf(stderr, "%s\n", Reader.GetError().c_str());
+        return 1;
+    }
+
+    if (!sProfile.empty()) {
+        string sError;
+        if (!WriteIndirectProfile(Reader, sSymbols, sProfile, sError)) {
+            fprintf(stderr, "%s\n", sError.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    // records before the first delimiter belong to no sampled invocation
+    vector<stIndexEntry> vecIndex;
+    Reader.LoadIndex(vecIndex, uThreads);
+
+    if (lOnly >= 0) {
+        if ((size_t)lOnly >= vecIndex.size()) {
+            fprintf(stderr, "the trace has %lu invocations\n", (unsigned long)vecIndex.size());
+            return 1;
+        }
+        stIndexEntry Entry = vecIndex[lOnly];
+        vecIndex.assign(1, Entry);
+    }
+
+    vector<stInvocation> vecInvocations;
+    map<int64_t, stLoopSummary> mapLoops;
+    AnalyzeInvocations(Reader, vecIndex, uGranularity, uThreads, uPrecision, uBudgetBytes, sTempDir,
+                       vecInvocations, mapLoops);
+
+    printf("invocation\tloop_id\taccesses\trms\tdistinct_writes\tcost\ttrip_count\tinput_sizes\n");
+
+    for (size_t i = 0; i < vecInvocations.size(); i++) {
+        PrintInvocation(vecInvocations[i]);
+    }
+
+    if (uPrecision != 0) {
+        PrintLoopSummaries(mapLoops);
+    }
+
+    if (bComplexity) {
+        PrintComplexity(vecInvocations);
+    }
+
+    if (bReuse) {
+        vector<stReuse> vecReuse;
+        map<int64_t, stReuseSummary> mapReuseLoops;
+        if (!AnalyzeReuse(Reader, vecIndex, uGranularity, uThreads, uBudgetBytes, sTempDir, vecReuse,
+                          mapReuseLoops)) {
+            return 1;
+        }
+        PrintReuse(vecIndex, vecReuse, mapReuseLoops);
+    }
+
+    if (uBudgetBytes != 0) {
+        ExternalCounter External(uBudgetBytes, sTempDir);
+        uint64_t uAccesses;
+        uint64_t uRMS;
+        uint64_t uDistinctWrites;
+
+        if (!AnalyzeTrace(Reader, vecIndex, uGranularity, External, uAccesses, uRMS, uDistinctWrites)) {
+            return 1;
+        }
+
+        printf("\naccesses\trms\tdistinct_writes\n");
+        printf("%lu\t%lu\t%lu\n", (unsigned long)uAccesses, (unsigned long)uRMS, (unsigned long)uDistinctWrites);
+    }
+
+    // consecutive invocations of a loop, so over the whole trace even with -n
+    if (bRedundancy) {
+        vector<stOverlap> vecPairs;
+        vector<stLoopRedundancy> vecLoops;
+        DetectRedundancy(Reader, vecPairs, vecLoops);
+        PrintRedundancy(vecPairs, vecLoops);
+    }
+
+    return 0;
+}